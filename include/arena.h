@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/** Numbers of allocations served by arenas and of memory blocks they requested from the system */
+class ArenaStats {
+public:
+    size_t allocations = 0;
+    size_t blocks = 0;
+    size_t block_bytes = 0;
+};
+
+/**
+ * Monotonic memory arena for short-lived scratch buffers
+ * Allocations are bumped from big blocks, single allocations are never freed: `rewind` drops everything
+ * allocated after a mark at once. Up to `KEPT_BLOCKS` blocks are kept after `rewind`, so a thread doing the same
+ * work for many nodes of partition tree asks the system for memory only a few times, while scratch of the biggest
+ * nodes is given back. Allocations bigger than a block are taken from the system directly and freed by `rewind`
+ */
+class Arena {
+public:
+    /** Position in arena that can be returned to by `rewind` */
+    class Mark {
+    public:
+        size_t block;
+        size_t offset;
+        size_t large_allocations;
+    };
+
+private:
+    static const size_t BLOCK_SIZE = (size_t) 1 << 20;
+    static const size_t KEPT_BLOCKS = 16;
+    /** Alignment of block starts, allocations aligned stricter are taken from the system directly */
+    static const size_t BLOCK_ALIGNMENT = 64;
+
+    std::vector<char *> blocks;
+    size_t current_block = 0;
+    size_t offset = 0;
+    /** Allocations bigger than a block or aligned stricter than its start, in order they were made */
+    std::vector<void *> large_allocations;
+    ArenaStats stats;
+
+    void *allocate_from_system(size_t bytes, size_t alignment);
+
+public:
+    /** Registers the arena, so that `arena_stats` sees its statistics while the thread runs */
+    Arena();
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    /** Frees the memory and keeps statistics of the arena in `arena_stats` */
+    ~Arena();
+
+    /** Returns `bytes` bytes aligned to `alignment`, that must be a power of two */
+    void *allocate(size_t bytes, size_t alignment);
+    Mark mark() const;
+    /** Makes memory allocated after `mark` available again, frees large allocations and blocks above the cap */
+    void rewind(const Mark &mark);
+    const ArenaStats &get_stats() const;
+};
+
+/** Arena of the calling thread */
+Arena &thread_arena();
+
+/**
+ * Statistics of arenas of all threads, finished and running
+ * Counters of other threads are exact only if they do not allocate at the moment, as pool workers waiting for tasks
+ */
+ArenaStats arena_stats();
+
+/** Rewinds arena of the calling thread to the state it had when the scope was created */
+class ArenaScope {
+private:
+    Arena &arena;
+    Arena::Mark mark;
+public:
+    ArenaScope() : arena(thread_arena()), mark(arena.mark()) {}
+    ~ArenaScope() { arena.rewind(mark); }
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+};
+
+/**
+ * Allocator of standard containers that takes memory from arena of the thread that created it
+ * Container must be used by that thread only and must be destroyed before the enclosing ArenaScope
+ */
+template<typename T, size_t Alignment = alignof(T)>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind {
+        typedef ArenaAllocator<U, (Alignment > alignof(U) ? Alignment : alignof(U))> other;
+    };
+
+    Arena *arena;
+
+    ArenaAllocator() : arena(&thread_arena()) {}
+    template<typename U, size_t OtherAlignment>
+    ArenaAllocator(const ArenaAllocator<U, OtherAlignment> &other) : arena(other.arena) {}
+
+    T *allocate(size_t count)
+    {
+        return static_cast<T *>(arena->allocate(count * sizeof(T), Alignment));
+    }
+
+    void deallocate(T *, size_t) {}
+};
+
+template<typename T, size_t TAlignment, typename U, size_t UAlignment>
+bool operator==(const ArenaAllocator<T, TAlignment> &a, const ArenaAllocator<U, UAlignment> &b)
+{
+    return a.arena == b.arena;
+}
+
+template<typename T, size_t TAlignment, typename U, size_t UAlignment>
+bool operator!=(const ArenaAllocator<T, TAlignment> &a, const ArenaAllocator<U, UAlignment> &b)
+{
+    return a.arena != b.arena;
+}
+
+/** Vector for scratch data of one partition step */
+template<typename T>
+using ScratchVector = std::vector<T, ArenaAllocator<T>>;
@@ -1,23 +1,86 @@
 #pragma once
 
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <mutex>
-#include <random>
+#include <string>
 #include "figure.h"
+#include "geom_utils.h"
 #include "parser.h"
 
+/**
+ * Plane that divides figure, given in the frame of the figure: position of a point is the sign of
+ * `normal * point + offset`, so faces are classified without turning their vertices
+ */
+class Cut {
+public:
+    Vec3 normal;
+    float offset;
+
+    Cut(const Vec3 &normal, float offset);
+    /** Plane through `line` of the space turned by `rotation_matrix` that is orthogonal to the turned xy plane */
+    Cut(const Mat3 &rotation_matrix, const Line &line);
+    /** Signed distance from `point` to the plane, scaled by length of `normal` */
+    constexpr float point_distance(const Point &point) const
+    {
+        return normal[0] * point.x + normal[1] * point.y + normal[2] * point.z + offset;
+    }
+    /** Position of face with vertices `face` relative to the cut */
+    Position face_position(const std::vector<Point> &face) const;
+    /** Position of face `face_id` of `figure` relative to the cut */
+    template<typename Index>
+    Position face_position(const BasicFigure<Index> &figure, size_t face_id) const;
+};
+
+/** Crossings found by histogram and exact cut search for the same directions in CUT_SEARCH_COMPARE mode */
+class CutSearchComparison {
+public:
+    std::atomic<size_t> directions{0};
+    std::atomic<size_t> same_crossings{0};
+    std::atomic<size_t> histogram_crossed{0};
+    std::atomic<size_t> exact_crossed{0};
+    std::atomic<size_t> events{0};
+    std::atomic<size_t> sorted_events{0};
+
+    /** Prints summary of the comparison to the standard output */
+    void print() const;
+};
+
+/**
+ * Returns seed of cut directions of partition tree node named `node_name`, like "_l_r" suffix or the whole
+ * subfigure filename. Nodes get their directions independently of the order they are processed in
+ */
+uint64_t node_seed(uint64_t seed, const std::string &node_name);
+
+/**
+ * Finds the best of `params.parts` cuts of `figure` with directions generated from `seed`
+ * Cut searches are added to `comparison` as in `partition`, unless it is nullptr
+ */
+template<typename Index>
+Cut find_cut(const BasicFigure<Index> &figure, const Parameters &params, uint64_t seed,
+             CutSearchComparison *comparison);
+
 /**
  * Cuts `figure` according to given parameters in `params`
  * All the resulting subfigures will be stored in `division`
  * `vector_mutex` is mutex for `division`
  * `save_filename` is name for saving subfigures if `params.save_partition` is true
+ *      Subfigures are saved by background threads, the function returns when all of them are saved
  * `save_filename` has suffix like "_l_r_r" that shows that base figure was divided 3 times
  *      and this part was by left side in first partition, and by right side in second and third
  * `depth` shows how many partitions were done before with this figure. On start should be 0
+ * Nodes of partition tree are ranges of one array of face ids of `figure` that is reordered in place,
+ * so subfigures are built only for leaves
+ * Subfigures are added to `division` in the order of their names. With the same `params.seed` the tree
+ * and `division` are the same on every run
+ * In CUT_SEARCH_COMPARE mode cut searches of all nodes are added to `comparison`, so it may sum up several trees
  */
-void partition(const Figure &figure,
+template<typename Index>
+void partition(const BasicFigure<Index> &figure,
                int depth,
                const std::string &save_filename,
-               std::vector<Figure> &division,
+               std::vector<BasicFigure<Index>> &division,
                std::mutex &vector_mutex,
-               const Parameters &params);
+               const Parameters &params,
+               CutSearchComparison &comparison);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "arena.h"
+#include "cutter.h"
+
+/**
+ * Positions of faces relative to a cut packed into 2-bit codes, 32 faces per word
+ * Face `i` is in bits [2 * (i % 32); 2 * (i % 32) + 2) of word `i / 32`. Codes past the last face are `PADDING`,
+ * so whole words can be counted
+ */
+class PackedPositions {
+public:
+    static const size_t FACES_PER_WORD = 32;
+    static const uint64_t PADDING = 3;
+
+private:
+    ScratchVector<uint64_t> words;
+    size_t face_count;
+
+public:
+    /** `face_count` faces with padding codes */
+    explicit PackedPositions(size_t face_count);
+
+    size_t size() const { return face_count; }
+    size_t word_count() const { return words.size(); }
+    uint64_t word(size_t word_id) const { return words[word_id]; }
+    void set_word(size_t word_id, uint64_t word) { words[word_id] = word; }
+
+    Position get(size_t face) const
+    {
+        return (Position) ((words[face / FACES_PER_WORD] >> (2 * (face % FACES_PER_WORD))) & 3);
+    }
+
+    void set(size_t face, Position position)
+    {
+        uint64_t &word = words[face / FACES_PER_WORD];
+        size_t shift = 2 * (face % FACES_PER_WORD);
+        word = (word & ~((uint64_t) 3 << shift)) | ((uint64_t) position << shift);
+    }
+
+    /** Number of faces at `position` among faces of words [`first_word`; `last_word`) */
+    size_t count(size_t first_word, size_t last_word, Position position) const;
+};
+
+/**
+ * Classifies `face_count` faces `faces` of `figure` by `cut` as `Cut::face_position` does
+ * If the faces use most of the vertices, signed distances of all vertices are computed first by SIMD projection
+ * kernels, otherwise distances of vertices of every face are computed on the fly.
+ * Words of codes are filled by at most `max_threads` threads. Codes are allocated in arena of the calling thread
+ */
+template<typename Index>
+PackedPositions classify_faces(const BasicFigure<Index> &figure, const Index *faces, size_t face_count,
+                               const Cut &cut, size_t max_threads);
@@ -1,57 +1,131 @@
 #pragma once
 
 #include "geom.h"
+#include "vertex_streams.h"
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <array>
 #include <functional>
 
+/** Indices of vertices of one face of Figure. Valid while the figure exists */
+template<typename Index>
+class BasicFaceView {
+private:
+    const Index *first;
+    const Index *last;
+public:
+    BasicFaceView(const Index *first, const Index *last) : first(first), last(last) {}
+    const Index *begin() const { return first; }
+    const Index *end() const { return last; }
+    size_t size() const { return last - first; }
+    size_t operator[](size_t i) const { return first[i]; }
+};
+
 /**
  * Class for storing model in a program
+ * `Index` is type of vertex and face ids: uint32_t for meshes that fit into it, otherwise size_t
  */
-class Figure {
+template<typename Index>
+class BasicFigure {
 private:
-    std::vector<Point> vertices;
-    std::vector<std::vector<size_t>> faces;
+    VertexStreams vertices;
+    /** Indices of vertices of all faces one after another */
+    std::vector<Index> indices;
+    /**
+     * Start of every face in `indices` followed by total number of indices
+     * Empty if every face is a triangle, then face `i` starts at 3 * `i`
+     */
+    std::vector<size_t> face_offsets;
     /**
      * Sets of faces that belongs to one component of a figure
      * If it is possible, after partition every face of each cluster will be in same subfigure
      * However, partition may split cluster if division is inconsistent
      */
-    std::vector<std::vector<size_t>> clusters;
+    std::vector<std::vector<Index>> clusters;
     /**
      * For each face number of cluster it belongs
      * If face doesn't belong to any cluster, -1
      */
     std::vector<int> face2cluster;
+    /** Fills `indices` and `face_offsets` from separate faces */
+    void flatten_faces(const std::vector<std::vector<size_t>> &faces);
+    /** Clears `face_offsets` if every face is a triangle */
+    void drop_triangle_offsets();
     template<typename T>
-    void copy_vertices(const Figure &figure, const std::vector<size_t> &faces, T &new_index,
+    void copy_vertices(const BasicFigure &figure, const std::vector<Index> &faces, T &new_index,
             const std::function<bool(size_t)> &is_presented);
 
 public:
-    const std::vector<Point> &get_vertices() const;
-    const std::vector<std::vector<size_t>> &get_faces() const;
-    const std::vector<std::vector<size_t>> &get_clusters() const;
+    /** Returns true if ids of `vertex_count` vertices and `face_count` faces fit into `Index` */
+    static bool can_index(size_t vertex_count, size_t face_count);
+    /** Vertex coordinates as aligned x, y and z streams, `get_vertices()[id]` gathers one vertex as Point */
+    const VertexStreams &get_vertices() const;
+    size_t face_count() const;
+    BasicFaceView<Index> face(size_t face_id) const;
+    /** Returns true if every face is a triangle, so `face_offsets` are not stored */
+    bool is_triangulated() const;
+    const std::vector<Index> &get_indices() const;
+    /** Empty if figure is triangulated */
+    const std::vector<size_t> &get_face_offsets() const;
+    const std::vector<std::vector<Index>> &get_clusters() const;
     const std::vector<int> &get_face2cluster() const;
-    /** Creates figure without clusters */
-    Figure(std::vector<Point> vertices, std::vector<std::vector<size_t>> faces);
+    /** Creates figure without clusters. Indices of `faces` must fit into `Index` */
+    BasicFigure(VertexStreams vertices, const std::vector<std::vector<size_t>> &faces);
+    /**
+     * Creates figure without clusters from flat faces, layout is the same as of `indices` and `face_offsets` members
+     * `face_offsets` may be given for triangulated figure too, then they are dropped
+     */
+    BasicFigure(VertexStreams vertices, std::vector<Index> indices, std::vector<size_t> face_offsets);
+    /** Creates figure with already known clusters. `face2cluster` must be consistent with `clusters` */
+    BasicFigure(VertexStreams vertices, std::vector<Index> indices, std::vector<size_t> face_offsets,
+                std::vector<std::vector<Index>> clusters, std::vector<int> face2cluster);
+    /** Copies figure with other index type together with its clusters. Ids of `figure` must fit into `Index` */
+    template<typename OtherIndex>
+    explicit BasicFigure(const BasicFigure<OtherIndex> &figure);
     /** Sets new clusters. If any clusters were set before, they will be removed */
-    void set_clusters(const std::vector<std::vector<size_t>> &clusters);
+    void set_clusters(const std::vector<std::vector<Index>> &clusters);
     /** Creates figure without clusters with vertices created from `points` */
-    Figure(const std::vector<std::array<double, 3>> &points, std::vector<std::vector<size_t>> faces);
+    BasicFigure(const std::vector<std::array<double, 3>> &points, const std::vector<std::vector<size_t>> &faces);
     /** Returns vertices of figure turned on given angles */
-    std::vector<Point> turned_points(float x_angle, float y_angle, float z_angle) const;
+    VertexStreams turned_points(float x_angle, float y_angle, float z_angle) const;
     /** Returns vertices of figure turned on given matrix */
-    std::vector<Point> turned_points(const Matrix &rotation_matrix) const;
+    VertexStreams turned_points(const Mat3 &rotation_matrix) const;
     /**
      * Returns figure turned on given angles.
      * Attention! Does not save clusters
      */
-    Figure turned(float x_angle, float y_angle, float z_angle) const;
+    BasicFigure turned(float x_angle, float y_angle, float z_angle) const;
     /**
      * Returns figure turned on given matrix.
      * Attention! Does not save clusters
      */
-    Figure turned(const Matrix &rotation_matrix) const;
+    BasicFigure turned(const Mat3 &rotation_matrix) const;
     /** Creates new figure as subfigure of `figure`, taking from `figure` only faces from `faces` */
-    Figure(const Figure &figure, const std::vector<size_t> &faces);
+    BasicFigure(const BasicFigure &figure, const std::vector<Index> &faces);
 };
+
+/** Members are defined in figure.cpp and instantiated only for these index types */
+extern template class BasicFigure<uint32_t>;
+extern template class BasicFigure<size_t>;
+
+typedef BasicFaceView<size_t> FaceView;
+typedef BasicFigure<size_t> Figure;
+/** Figure with half-size indices, used when mesh has less than 2^32 vertices and faces */
+typedef BasicFigure<uint32_t> Figure32;
+
+template<typename Index>
+inline size_t BasicFigure<Index>::face_count() const
+{
+    return face_offsets.empty() ? indices.size() / 3 : face_offsets.size() - 1;
+}
+
+template<typename Index>
+inline BasicFaceView<Index> BasicFigure<Index>::face(size_t face_id) const
+{
+    if (face_offsets.empty())
+    {
+        return BasicFaceView<Index>(indices.data() + 3 * face_id, indices.data() + 3 * face_id + 3);
+    }
+    return BasicFaceView<Index>(indices.data() + face_offsets[face_id], indices.data() + face_offsets[face_id + 1]);
+}
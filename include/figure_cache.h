@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "figure.h"
+
+/**
+ * Cache file keeps figure together with its clusters in the layout of Figure itself,
+ * so restoring it needs no parsing, only copying of sections from the mapped file.
+ *
+ * Layout (little-endian, every section is padded to 8 bytes):
+ *      FigureCacheHeader
+ *      key                 char[key_length]
+ *      vertex_x            float[vertex_count]
+ *      vertex_y            float[vertex_count]
+ *      vertex_z            float[vertex_count]
+ *      face_offsets        index[face_count + 1]
+ *      face_indices        index[index_count]
+ *      cluster_offsets     index[cluster_count + 1]
+ *      cluster_faces       index[cluster_face_count]
+ *      face2cluster        int32[face_count]
+ * where index is uint32 or uint64 depending on `index_size`
+ */
+class FigureCacheHeader {
+public:
+    char magic[8];
+    uint32_t version;
+    uint32_t index_size;
+    /** Size, modification time in nanoseconds and hash of the file figure was read from */
+    uint64_t source_size;
+    uint64_t source_mtime;
+    uint64_t source_hash;
+    uint64_t key_length;
+    uint64_t vertex_count;
+    uint64_t face_count;
+    uint64_t index_count;
+    uint64_t cluster_count;
+    uint64_t cluster_face_count;
+};
+
+/**
+ * Returns true if `cache_filename` is a complete cache built from current contents of `source_filename`
+ * with parameters described by `key`. Source is hashed only if its size and modification time match the cache
+ */
+bool cache_matches(const std::string &cache_filename, const std::string &source_filename, const std::string &key);
+
+/**
+ * Restores figure with clusters from cache file checked with `cache_matches`
+ * Ids of cached figure must fit into `Index`
+ */
+template<typename Index>
+BasicFigure<Index> read_figure_cache(const std::string &cache_filename);
+
+/**
+ * Saves `figure` read from `source_filename` with its clusters into cache file `cache_filename`
+ * Throws std::runtime_error if it fails
+ */
+template<typename Index>
+void write_figure_cache(const std::string &cache_filename, const std::string &source_filename, const std::string &key,
+                        const BasicFigure<Index> &figure);
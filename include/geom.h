@@ -1,23 +1,66 @@
 #pragma once
 
-#include <vector>
+#include <cstddef>
 
-class Matrix {
+/** Row vector of three floats */
+class Vec3 {
 public:
-    std::vector<std::vector<float>> matrix;
-    explicit Matrix(std::vector<std::vector<float>> matrix);
-    Matrix operator*(const Matrix &other) const;
+    float values[3];
+
+    constexpr float operator[](size_t i) const { return values[i]; }
+};
+
+/** 3x3 matrix kept on stack. Vectors are rows and are multiplied by matrix on the right side */
+class Mat3 {
+public:
+    float matrix[3][3];
+
+    constexpr Mat3 operator*(const Mat3 &other) const;
 };
 
+constexpr Mat3 Mat3::operator*(const Mat3 &other) const
+{
+    Mat3 result = {};
+    for (size_t row = 0; row < 3; ++row)
+    {
+        for (size_t index = 0; index < 3; ++index)
+        {
+            for (size_t column = 0; column < 3; ++column)
+            {
+                result.matrix[row][column] += matrix[row][index] * other.matrix[index][column];
+            }
+        }
+    }
+    return result;
+}
+
+// Sums start from the first product, not from zero, so that -0 products stay -0 as in SIMD turn kernels
+constexpr Vec3 operator*(const Vec3 &vector, const Mat3 &matrix)
+{
+    Vec3 result = {};
+    for (size_t column = 0; column < 3; ++column)
+    {
+        result.values[column] = vector[0] * matrix.matrix[0][column] + vector[1] * matrix.matrix[1][column] +
+                                vector[2] * matrix.matrix[2][column];
+    }
+    return result;
+}
+
 class Point {
 public:
     float x, y, z;
 
-    Matrix to_matrix() const;
+    constexpr Vec3 to_vec3() const { return {{x, y, z}}; }
     Point turned(float x_angle, float y_angle, float z_angle) const;
-    Point turned(const Matrix &rotation_matrix) const;
+    constexpr Point turned(const Mat3 &rotation_matrix) const;
 };
 
+constexpr Point Point::turned(const Mat3 &rotation_matrix) const
+{
+    Vec3 turned = to_vec3() * rotation_matrix;
+    return {turned[0], turned[1], turned[2]};
+}
+
 class Point2d {
 public:
     float x, y;
@@ -3,6 +3,8 @@
 #include "figure.h"
 #include "geom.h"
 #include "geom.h"
+#include <cmath>
+#include <random>
 #include <vector>
 
 enum Position {
@@ -11,12 +13,75 @@ enum Position {
     CROSS
 };
 
-Position line_triangle_position(const Line &line, const std::vector<size_t> &face, const Figure &figure);
+/** Points closer than this to a line or a plane lie on it */
+const float INTERSECT_EPS = 1e-6;
 
-Matrix get_rotation_matrix(float x_angle, float y_angle, float z_angle);
+/**
+ * Position of polygon relative to a line or a plane, `distance(vertex)` is signed distance of each of `vertices`.
+ * CROSS if some vertex lies on the cut or vertices are on both sides. Has no branches per vertex
+ */
+template<typename Vertices, typename Distance>
+inline Position polygon_position(const Vertices &vertices, const Distance &distance)
+{
+    bool on_cut = false;
+    bool has_left = false;
+    bool has_right = false;
+    for (auto vertex : vertices)
+    {
+        float vertex_distance = distance(vertex);
+        on_cut |= std::fabs(vertex_distance) <= INTERSECT_EPS;
+        has_right |= vertex_distance < 0;
+        has_left |= !(vertex_distance < 0);
+    }
+    return on_cut || has_left == has_right ? CROSS : has_left ? LEFT : RIGHT;
+}
 
-/** Returns random number in [0; 2*PI] */
-float generate_random_angle();
+Mat3 get_rotation_matrix(float x_angle, float y_angle, float z_angle);
+
+/**
+ * Writes coordinate `axis` (0 for x, 1 for y, 2 for z) of every vertex turned by `rotation_matrix` into `turned`
+ * `turned` must hold `vertices.padded_size()` floats, padding is filled too.
+ * Uses SIMD kernel chosen for the processor, result is the same as of `Point::turned`
+ */
+void turn_coordinate(const VertexStreams &vertices, const Mat3 &rotation_matrix, int axis, float *turned);
+
+/**
+ * Writes projection of every vertex on `directions[k]` into `projected[k]`, each must hold `vertices.padded_size()`
+ * floats. Vertices are split into ranges projected by at most `max_threads` threads
+ */
+void project_vertices(const VertexStreams &vertices, const Vec3 *directions, size_t direction_count,
+                      float *const *projected, size_t max_threads);
+
+/**
+ * Same as `turn_coordinate` for `matrix_count` matrices in one blocked pass over the vertices,
+ * coordinate turned by `rotation_matrices[k]` is written into `turned[k]`.
+ * Vertices are split into ranges turned by at most `max_threads` threads
+ */
+void turn_coordinate(const VertexStreams &vertices, const Mat3 *rotation_matrices, size_t matrix_count, int axis,
+                     float *const *turned, size_t max_threads);
+
+/** Returns coordinate `axis` of `point` turned by `rotation_matrix`, the same as of `point.turned(rotation_matrix)` */
+constexpr float turn_coordinate(const Point &point, const Mat3 &rotation_matrix, int axis)
+{
+    return point.x * rotation_matrix.matrix[0][axis] + point.y * rotation_matrix.matrix[1][axis] +
+           point.z * rotation_matrix.matrix[2][axis];
+}
+
+/** Returns `vertices` turned by `rotation_matrix` with SIMD kernel, as `turn_coordinate` for every axis */
+VertexStreams turn_vertices(const VertexStreams &vertices, const Mat3 &rotation_matrix);
+
+/** Returns difference between maximum and minimum of first `count` values of coordinate stream `values` */
+float stream_extent(const float *values, size_t count);
+
+/** Returns random number in [0; 2*PI] from `generator` */
+float generate_random_angle(std::mt19937_64 &generator);
+
+/**
+ * Returns `count` rotation matrices for cut directions: turned x axis of matrix `i` is point `i` of Fibonacci
+ * lattice on a half of the sphere, and the whole lattice is turned randomly by `generator`.
+ * Opposite directions give the same cuts, so the half of the sphere is covered evenly without near-duplicates
+ */
+std::vector<Mat3> generate_cut_rotations(size_t count, std::mt19937_64 &generator);
 
 class Vector3d {
 public:
@@ -31,7 +96,8 @@ Vector3d operator*(float x, const Vector3d &a);
 
 Vector3d operator/(const Vector3d &a, float x);
 
-Vector3d build_normal(size_t face_id, const Figure& figure);
+template<typename Index>
+Vector3d build_normal(size_t face_id, const BasicFigure<Index> &figure);
 
 float distance(Vector3d a, Vector3d b);
 
@@ -2,7 +2,13 @@
 
 #include "figure.h"
 #include "parser.h"
+#include <cstdint>
 #include <vector>
 
-/** Finds interesting regions of mesh (clusters) with size specified in parameters */
-std::vector<std::vector<size_t>> divide_interesting(const Figure &figure, const Parameters &params);
+/**
+ * Finds interesting regions of mesh (clusters) with size specified in parameters
+ * Random directions of the test for line-like clusters are generated from `seed`, so clusters are the same on every run
+ */
+template<typename Index>
+std::vector<std::vector<Index>> divide_interesting(const BasicFigure<Index> &figure, const Parameters &params,
+                                                   uint64_t seed);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/** Order in which a mapping is going to be read, passed to the kernel as a hint */
+enum MappedAccess {
+    /** File is read from start to end: pages are prefetched aggressively and dropped soon after they are read */
+    MAPPED_SEQUENTIAL,
+    /** Reads jump around the file, as lookups of vertices by face: the kernel keeps its default prefetching */
+    MAPPED_NORMAL
+};
+
+/**
+ * Read-only memory mapping of a whole file
+ * The mapping is released when the object is destroyed
+ */
+class MappedFile {
+private:
+    const char *data = nullptr;
+    size_t length = 0;
+public:
+    /** Maps file `path` into memory. Throws std::runtime_error if file cannot be opened or mapped */
+    MappedFile(const std::string &path, MappedAccess access);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    const char *begin() const;
+    const char *end() const;
+    size_t size() const;
+};
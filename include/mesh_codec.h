@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "figure.h"
+
+/**
+ * Compressed mesh format
+ * Faces are reordered for vertex cache locality and vertices are renumbered in order of first use,
+ * so indices are stored as small varint distances to the next unused index.
+ * Positions and UVs are quantized inside their bounding boxes and stored as varint deltas.
+ * Decoded figure has the same faces up to their order, positions are accurate up to quantization step
+ */
+
+/** Returns true if memory [`begin`; `end`) holds a compressed mesh */
+bool is_compressed_mesh(const char *begin, const char *end);
+
+/**
+ * Reads numbers of vertices and faces of compressed mesh located in memory [`begin`; `end`)
+ * Throws std::runtime_error if there is no header
+ */
+void read_compressed_mesh_size(const char *begin, const char *end, size_t &vertex_count, size_t &face_count);
+
+/**
+ * Encodes `figure` into file `filename`
+ * If `uvs` and `uvfaces` are given, they are encoded as well
+ */
+template<typename Index>
+void write_compressed_mesh(const std::string &filename, const BasicFigure<Index> &figure,
+                           const std::vector<Point2d> *uvs = nullptr,
+                           const std::vector<std::vector<size_t>> *uvfaces = nullptr);
+
+/**
+ * Decodes compressed mesh located in memory [`begin`; `end`)
+ * If `uvs` and `uvfaces` are given, UVs are decoded into them (empty if the mesh has no UVs).
+ * Throws std::runtime_error if data is malformed
+ */
+template<typename Index>
+BasicFigure<Index> read_compressed_mesh(const char *begin, const char *end, std::vector<Point2d> *uvs = nullptr,
+                                        std::vector<std::vector<size_t>> *uvfaces = nullptr);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "figure.h"
+#include "parser.h"
+
+/**
+ * Returns true if partition of mesh in `filename` is estimated to need more memory than `params.memory_limit`
+ * and the file can be processed by `out_of_core_partition` (binary little-endian ply)
+ */
+bool needs_out_of_core(const std::string &filename, const Parameters &params);
+
+/**
+ * Partitions mesh in `filename` without loading it whole.
+ * Top levels of partition tree are found on a sample of faces, then all faces are routed into
+ * spill files of top-level parts, and every part is loaded and partitioned in memory on its own.
+ * If `params.clusterization` is on, clusters are searched inside every part separately.
+ * Subfigures of every part are passed to `process_part` together with suffix of the part like "_l_r" before the
+ * next part is loaded, so only one part with its subfigures is in memory at a time. `process_part` may take
+ * the subfigures away. Names of saved subfigures are the same as in `partition`
+ * Ids of the mesh must fit into `Index`
+ */
+template<typename Index>
+void out_of_core_partition(const std::string &filename, const std::string &save_filename, const Parameters &params,
+                           const std::function<void(std::vector<BasicFigure<Index>> &, const std::string &)>
+                                   &process_part);
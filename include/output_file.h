@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * File opened for writing at arbitrary positions, so that several threads can fill disjoint parts of it
+ * File is closed when the object is destroyed
+ */
+class OutputFile {
+private:
+    int fd;
+    std::string filename;
+public:
+    /** Creates or truncates `filename`. Throws std::runtime_error if file cannot be opened */
+    explicit OutputFile(const std::string &filename);
+    ~OutputFile();
+    OutputFile(const OutputFile &) = delete;
+    OutputFile &operator=(const OutputFile &) = delete;
+    /** Reserves `size` bytes for the file, so that its parts can be written in any order */
+    void preallocate(size_t size);
+    /** Writes `size` bytes of `data` at `offset`. Throws std::runtime_error if it fails */
+    void write_at(const void *data, size_t size, size_t offset);
+};
+
+/** Sequential writer into a part of OutputFile that collects small records into big chunks */
+class BufferedWriter {
+private:
+    OutputFile &file;
+    size_t offset;
+    std::vector<char> buffer;
+    size_t used = 0;
+public:
+    /** Writer that starts at `offset` of `file`. Buffered data is written only on `flush` or when buffer is full */
+    BufferedWriter(OutputFile &file, size_t offset, size_t capacity = 1 << 22);
+    void write(const void *data, size_t size);
+    template<typename T>
+    void put(T value)
+    {
+        if (buffer.size() - used < sizeof(T))
+        {
+            flush();
+        }
+        std::memcpy(buffer.data() + used, &value, sizeof(T));
+        used += sizeof(T);
+    }
+    void flush();
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+
+/**
+ * Sets number of threads used by the thread pool, 0 means number of hardware threads
+ * Has effect only if called before the first call of `thread_count`
+ */
+void set_thread_count(size_t threads);
+
+/** Number of threads used by data-parallel loops and tasks, including the thread that waits for them */
+size_t thread_count();
+
+/**
+ * Group of tasks run by the global work-stealing thread pool
+ * Pool has `thread_count() - 1` workers, each of them takes its own latest tasks first and steals the oldest tasks
+ * of other threads, so tasks spawned close to the root of recursion are stolen first.
+ * Thread that waits for a group runs pending tasks meanwhile, so tasks may spawn and wait for groups themselves.
+ * Threads that are not workers of the pool run only tasks of the group they wait for
+ */
+class TaskGroup {
+private:
+    std::atomic<size_t> pending{0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    void wait_tasks();
+
+public:
+    TaskGroup() = default;
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+    /** Waits for tasks of the group, their exceptions are dropped */
+    ~TaskGroup();
+
+    /** Schedules `task`. It may run in any worker of the pool or in thread that waits for the group */
+    void run(std::function<void()> task);
+    /** Waits for all tasks of the group. If some of them threw, the first exception is rethrown */
+    void wait();
+
+    /** Called by the pool when a task of the group is finished, `task_error` is null if it did not throw */
+    void finish_task(std::exception_ptr task_error);
+};
+
+/**
+ * Splits [0; `size`) into contiguous ranges and calls `body(begin, end)` for each of them in parallel
+ * Ranges are made not shorter than `min_range` elements, so small inputs are processed by the calling thread only.
+ * If `body` throws, the first exception is rethrown in the calling thread after all ranges are finished
+ */
+void parallel_for(size_t size, size_t min_range, const std::function<void(size_t, size_t)> &body);
@@ -2,6 +2,17 @@
 
 #include <string>
 #include <climits>
+#include <cstdint>
+
+/** Algorithm that searches for the best cut along one direction */
+enum CutSearch {
+    /** Sorts all face events */
+    CUT_SEARCH_EXACT,
+    /** Sorts only events of histogram bins that can hold the best cut, linear time */
+    CUT_SEARCH_HISTOGRAM,
+    /** Runs both and prints how their crossing counts compare, cuts of histogram search are used */
+    CUT_SEARCH_COMPARE
+};
 
 class Parameters {
 public:
@@ -41,13 +52,54 @@ public:
     bool optimize_clusters = false;
     /** If this parameter is on, files with subfigures that are given to parametrizer will be saved */
     bool save_partition = false;
+    /**
+     * If this parameter is on, output files are preallocated and filled by several threads at once.
+     * It is fast on SSD, but may be slower than sequential writing on spinning disks and network shares
+     */
+    bool parallel_write = true;
+    /**
+     * If this parameter is on, output files store float coordinates and every UV once in separate element
+     * indexed from faces, instead of double coordinates and UVs repeated in every face
+     */
+    bool compact_output = false;
+    /**
+     * If this parameter is on, result and saved subfigures are written as compressed meshes
+     * (quantized coordinates, varint-coded indices) instead of ply. Such files can be given back as input
+     */
+    bool compress_output = false;
+    /**
+     * If this parameter is on, figure read from `filename` is saved together with its clusters
+     * into "`filename`.cache" and is loaded from there on next runs with the same file and clustering parameters.
+     * Off by default, since cache is as big as the mesh and takes a pass over the whole input to check
+     */
+    bool use_cache = false;
+    /**
+     * Memory in megabytes available for partition. If partition of mesh from binary ply is estimated to need more,
+     * faces are first split into parts on disk and every part is partitioned separately (out-of-core mode).
+     * Then every part is parametrized on its own into `output_filename` with suffix of the part before extension,
+     * like "out_l_r.ply". 0 means no limit
+     */
+    size_t memory_limit = 0;
+    /** If this parameter is on, throughput of vertex turn kernels of every instruction set is printed before partition */
+    bool benchmark_kernels = false;
+    /** Algorithm of cut search along every direction */
+    CutSearch cut_search = CUT_SEARCH_EXACT;
+    /** Number of threads that partition the mesh. 0 means number of hardware threads */
+    size_t threads = 0;
+    /**
+     * Seed of cut directions. Partition is the same on every run with the same seed and other parameters.
+     * If it is 0, a random seed is chosen and printed
+     */
+    uint64_t seed = 0;
     /** Returns text description of parameters. For instance, can be used as a filename */
     std::string to_string() const;
+    /** Returns text description of parameters that affect clusterization */
+    std::string clustering_to_string() const;
 };
 
 /**
  * Parses command line parameters
- * Format: ./separate_uvatlas <filename> [--depth INT] [--size INT] [--parts INT] [--cluster] [--cluster-min-size INT] [--cluster-max-size INT] [--output STRING] [--part-save]
+ * Format: ./separate_uvatlas <filename> [--depth INT] [--size INT] [--parts INT] [--cluster] [--cluster-min-size INT] [--cluster-max-size INT] [--output STRING] [--part-save] [--sequential-write] [--compact-output] [--compress-output] [--cache] [--memory-limit INT] [--benchmark-kernels] [--cut-search exact|histogram|compare] [--threads INT] [--seed INT]
  * At least one of --depth or --size must be specified
 */
 Parameters parse_parameters(int argc, char ** argv);
@@ -4,14 +4,28 @@
 #include "figure.h"
 #include "uv_atlas.h"
 #include "integration.h"
+#include "ply_writer.h"
+#include "parser.h"
 #include <vector>
 #include <string>
 
-/** Reads mesh from file without UVs */
-Figure read_mesh(const std::string &path_to_ply);
+/**
+ * Reads numbers of vertices and faces from header of ply or compressed mesh file
+ * Returns false if header cannot be parsed
+ */
+bool read_mesh_size(const std::string &path_to_ply, size_t &vertex_count, size_t &face_count);
 
-/** Saves figure after decomposition into UV-atlas */
-void save_figure(ParametrizedFigure &parameterized, const std::string &filename);
+/** Reads mesh from ply or compressed mesh file without UVs. Ids of the mesh must fit into `Index` */
+template<typename Index>
+BasicFigure<Index> read_mesh(const std::string &path_to_ply);
+
+/**
+ * Saves figure after decomposition into UV-atlas
+ * Format is chosen by `params`: compressed mesh if `params.compress_output` is on, otherwise ply
+ * with layout chosen by `params.compact_output` and written by several threads if `params.parallel_write` is on
+ */
+void save_figure(ParametrizedFigure &parameterized, const std::string &filename, const Parameters &params);
 
 /** Saves figure without UVs */
-void save_figure(const Figure &figure, const std::string &filename);
+template<typename Index>
+void save_figure(const BasicFigure<Index> &figure, const std::string &filename, const Parameters &params);
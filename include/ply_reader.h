@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "geom.h"
+#include "vertex_streams.h"
+
+enum PlyFormat {
+    PLY_ASCII,
+    PLY_BINARY_LITTLE_ENDIAN,
+    PLY_BINARY_BIG_ENDIAN
+};
+
+enum PlyType {
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64
+};
+
+/** Returns true if binary little-endian ply values can be copied to and from memory as is */
+bool is_little_endian();
+
+/** Size in bytes of one value of type `type` in binary ply */
+size_t ply_type_size(PlyType type);
+
+class PlyProperty {
+public:
+    std::string name;
+    PlyType type;
+    bool is_list = false;
+    /** Type of list length. Used only if `is_list` is true */
+    PlyType count_type;
+};
+
+class PlyElement {
+public:
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+    /** Size of one record in bytes or 0 if element has list properties */
+    size_t stride() const;
+    /** Returns index of property with name `name` or -1 if there is no such property */
+    int find_property(const std::string &name) const;
+};
+
+/** Description of a ply file that is enough to locate its data without parsing it */
+class PlyHeader {
+public:
+    PlyFormat format;
+    std::vector<PlyElement> elements;
+    /** Offset of the first byte after the "end_header" line */
+    size_t data_offset = 0;
+};
+
+/** Location of vertex coordinates inside a record of vertex element without list properties */
+class PlyVertexLayout {
+public:
+    size_t stride = 0;
+    size_t offsets[3] = {0, 0, 0};
+    PlyType types[3];
+    /**
+     * True if x, y, z are consecutive floats, so they are decoded into Point by one copy
+     * Vertex streams are filled coordinate by coordinate from the decoded Point either way
+     */
+    bool packed_floats = false;
+
+    PlyVertexLayout() = default;
+    /** `element` must have x, y, z properties */
+    explicit PlyVertexLayout(const PlyElement &element);
+    /** Reads vertex from record that starts at `record` */
+    Point decode(const char *record) const;
+};
+
+/**
+ * Parses ply header located in memory [`begin`; `end`) into `header`
+ * Returns false if header is malformed or uses types unknown to this reader
+ */
+bool parse_ply_header(const char *begin, const char *end, PlyHeader &header);
+
+/**
+ * Decodes vertex positions and faces of a binary little-endian ply located in memory [`begin`; `end`)
+ * Faces are stored as in Figure: `indices` of all faces one after another and `face_offsets` with start
+ * of every face followed by total number of indices, or empty `face_offsets` if every face is a triangle.
+ * Supports float or double coordinates and integer face indices, other properties are skipped.
+ * Indices are stored as `Index` (uint32_t or size_t), so vertex count must fit into it.
+ * Returns false if layout of the file is not supported, outputs are left in unspecified state then.
+ * Throws std::runtime_error if data is truncated
+ */
+template<typename Index>
+bool read_binary_mesh(const char *begin, const char *end, const PlyHeader &header, VertexStreams &vertices,
+                      std::vector<Index> &indices, std::vector<size_t> &face_offsets);
+
+/**
+ * Same as `read_binary_mesh`, but for ascii ply
+ * Lines are located and parsed in parallel chunks.
+ * Throws std::runtime_error if data is truncated or values cannot be parsed
+ */
+template<typename Index>
+bool read_ascii_mesh(const char *begin, const char *end, const PlyHeader &header, VertexStreams &vertices,
+                     std::vector<Index> &indices, std::vector<size_t> &face_offsets);
+
+/**
+ * Binary little-endian ply mesh in memory that is decoded on demand instead of being loaded whole
+ * Memory and header given to `open` must outlive the object
+ */
+class BinaryPlyMesh {
+private:
+    const PlyElement *vertex_element = nullptr;
+    const PlyElement *face_element = nullptr;
+    int indices_id = -1;
+    PlyVertexLayout layout;
+    const char *vertex_data = nullptr;
+    const char *face_data = nullptr;
+    const char *end = nullptr;
+public:
+    /**
+     * Locates vertices and faces of ply in memory [`begin`; `end`) described by `header`
+     * Returns false if layout is not supported by `read_binary_mesh`. Throws std::runtime_error if data is truncated
+     */
+    bool open(const char *begin, const char *end, const PlyHeader &header);
+    size_t vertex_count() const;
+    size_t face_count() const;
+    Point vertex(size_t vertex_id) const;
+    /** Calls `callback(face_id, face)` for every face in order of file */
+    void for_each_face(const std::function<void(size_t, const std::vector<size_t> &)> &callback) const;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "figure.h"
+
+/** Layout of ply files written by `write_ply` */
+enum PlySchema {
+    /**
+     * Layout happly produced: double vertex coordinates, uint vertex indices
+     * and "texcoord" list with UVs of first three corners of every face
+     */
+    PLY_SCHEMA_HAPPLY,
+    /**
+     * float vertex coordinates, uint vertex indices, UVs stored once in "uv" element with float "u", "v"
+     * and indexed from every face by "uv_indices" list
+     */
+    PLY_SCHEMA_COMPACT
+};
+
+/**
+ * Streams `figure` into binary little-endian ply `filename` with layout `schema`.
+ * If `uvs` and `uvfaces` are given, UVs are written as well.
+ * If `parallel` is true, the file is preallocated and vertex, uv and face ranges are written concurrently
+ * at their precomputed offsets, otherwise the file is written from start to end by the calling thread
+ */
+template<typename Index>
+void write_ply(const std::string &filename, const BasicFigure<Index> &figure, bool parallel, PlySchema schema,
+               const std::vector<Point2d> *uvs = nullptr, const std::vector<std::vector<size_t>> *uvfaces = nullptr);
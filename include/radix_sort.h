@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/** Maps float to unsigned integer, so that integers are ordered as the floats were */
+inline uint32_t sortable_key(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+/** Inverse of `sortable_key` */
+inline float sortable_key_value(uint32_t key)
+{
+    uint32_t bits = (key & 0x80000000u) ? key & ~0x80000000u : ~key;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * Stable LSD radix sort of `count` unsigned integers of `data` by their highest 32 bits, lower bits are payload
+ * `buffer` must hold `count` values. Sorted values are in `data` after the call.
+ * Every pass is split into chunks that are counted and scattered by at most `max_threads` threads.
+ * Instantiated for uint64_t and unsigned __int128
+ */
+template<typename T>
+void radix_sort_by_key(T *data, T *buffer, size_t count, size_t max_threads);
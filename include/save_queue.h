@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "figure.h"
+#include "parser.h"
+
+/**
+ * Saves figures into ply files by background threads, so that the threads producing figures do not wait for disk
+ * Figures are shared with the caller that keeps them for parametrization anyway, so the queue does not limit their
+ * memory and `push` never waits: it is called by workers of the thread pool
+ */
+template<typename Index>
+class SaveQueue {
+private:
+    class Task {
+    public:
+        std::shared_ptr<const BasicFigure<Index>> figure;
+        std::string filename;
+    };
+
+    const Parameters &params;
+    std::deque<Task> tasks;
+    bool finished = false;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable task_added;
+    std::vector<std::thread> threads;
+
+    void work();
+    void save(const Task &task);
+public:
+    /**
+     * Starts `thread_count` saving threads. If `thread_count` is 0, figures are saved in `push` by calling thread
+     * `params` are passed to `save_figure` and must outlive the queue
+     */
+    SaveQueue(size_t thread_count, const Parameters &params);
+    /** Saves the rest of figures. Exceptions of saving are lost, so `finish` should be called before */
+    ~SaveQueue();
+    SaveQueue(const SaveQueue &) = delete;
+    SaveQueue &operator=(const SaveQueue &) = delete;
+    /** Queues `figure` to be saved into `filename` */
+    void push(std::shared_ptr<const BasicFigure<Index>> figure, const std::string &filename);
+    /** Waits until all figures are saved. Rethrows the first exception thrown by saving */
+    void finish();
+};
+
+extern template class SaveQueue<uint32_t>;
+extern template class SaveQueue<size_t>;
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include "geom.h"
+#include "vertex_streams.h"
+
+/** Instruction set used by turn kernels */
+enum KernelIsa {
+    KERNEL_SCALAR,
+    KERNEL_SSE2,
+    KERNEL_AVX2,
+    KERNEL_AVX512
+};
+
+/** The best instruction set supported by the processor, detected by cpuid on first call */
+KernelIsa kernel_isa();
+
+/** Returns true if kernels for `isa` are compiled in and the processor can run them */
+bool is_kernel_isa_supported(KernelIsa isa);
+
+const char *kernel_isa_name(KernelIsa isa);
+
+/**
+ * Writes `x[i] * direction[0] + y[i] * direction[1] + z[i] * direction[2]` into `projected[i]` for i in [0; `count`)
+ * `count` must be a multiple of `VertexStreams::WIDTH`, as padded size of vertex streams is.
+ * Kernels of all instruction sets multiply and add in the same order without fusing, so results are the same
+ */
+void project_streams(const float *x, const float *y, const float *z, size_t count, const Vec3 &direction,
+                     float *projected, KernelIsa isa = kernel_isa());
+
+/**
+ * Same as `project_streams` for `direction_count` directions at once, `projected[k]` receives projection on
+ * `directions[k]`. Vertices are processed in blocks that stay in cache while they are projected on every direction,
+ * so the streams are read from memory once instead of once per direction
+ */
+void project_streams(const float *x, const float *y, const float *z, size_t count, const Vec3 *directions,
+                     size_t direction_count, float *const *projected, KernelIsa isa = kernel_isa());
+
+/** Turns `count` vertices by `rotation_matrix` reading every stream once. Requirements are as in `project_streams` */
+void turn_streams(const float *x, const float *y, const float *z, size_t count, const Mat3 &rotation_matrix,
+                  float *turned_x, float *turned_y, float *turned_z, KernelIsa isa = kernel_isa());
+
+/**
+ * Prints throughput of projection, rotation and blocked projection kernels for every supported instruction set
+ * on `vertices`
+ */
+void benchmark_turn_kernels(const VertexStreams &vertices);
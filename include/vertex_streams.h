@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include "geom.h"
+
+/** Allocator of memory aligned to `Alignment` bytes */
+template<typename T, size_t Alignment>
+class AlignedAllocator {
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+    T *allocate(size_t count)
+    {
+        void *pointer = nullptr;
+        if (count > 0 && posix_memalign(&pointer, Alignment, count * sizeof(T)) != 0)
+        {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(pointer);
+    }
+
+    void deallocate(T *pointer, size_t)
+    {
+        std::free(pointer);
+    }
+};
+
+template<typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment> &, const AlignedAllocator<U, Alignment> &)
+{
+    return true;
+}
+
+template<typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment> &, const AlignedAllocator<U, Alignment> &)
+{
+    return false;
+}
+
+/** Alignment of vertex streams in bytes, one cache line */
+const size_t STREAM_ALIGNMENT = 64;
+
+/** Array of floats aligned as streams of VertexStreams */
+typedef std::vector<float, AlignedAllocator<float, STREAM_ALIGNMENT>> AlignedFloats;
+
+/**
+ * Vertex positions stored as three separate streams of x, y and z coordinates
+ * Every stream starts at `STREAM_ALIGNMENT` bytes boundary and is padded with zeros to multiple of `WIDTH` floats,
+ * so kernels may process whole `WIDTH` blocks without a scalar tail
+ */
+class VertexStreams {
+public:
+    static const size_t WIDTH = STREAM_ALIGNMENT / sizeof(float);
+
+private:
+    AlignedFloats data;
+    size_t count = 0;
+    size_t padded_count = 0;
+
+public:
+    VertexStreams() = default;
+    /** Creates `count` vertices at the origin */
+    explicit VertexStreams(size_t count);
+    /** Converts array of points, so that code building `std::vector<Point>` can create Figure as before */
+    VertexStreams(const std::vector<Point> &points);
+
+    size_t size() const { return count; }
+    /** Size of every stream including padding, multiple of `WIDTH` */
+    size_t padded_size() const { return padded_count; }
+    const float *x() const { return data.data(); }
+    const float *y() const { return data.data() + padded_count; }
+    const float *z() const { return data.data() + 2 * padded_count; }
+    float *x() { return data.data(); }
+    float *y() { return data.data() + padded_count; }
+    float *z() { return data.data() + 2 * padded_count; }
+
+    /** Iterator that gathers vertices as Point, so streams can be walked by range-based for */
+    class const_iterator {
+    private:
+        const VertexStreams *vertices;
+        size_t vertex_id;
+    public:
+        const_iterator(const VertexStreams *vertices, size_t vertex_id) : vertices(vertices), vertex_id(vertex_id) {}
+        Point operator*() const { return (*vertices)[vertex_id]; }
+        const_iterator &operator++() { ++vertex_id; return *this; }
+        bool operator==(const const_iterator &other) const { return vertex_id == other.vertex_id; }
+        bool operator!=(const const_iterator &other) const { return vertex_id != other.vertex_id; }
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+    /** Gathers vertex `vertex_id` from the streams */
+    Point operator[](size_t vertex_id) const { return {x()[vertex_id], y()[vertex_id], z()[vertex_id]}; }
+    void set(size_t vertex_id, const Point &point);
+    /** Returns vertices as array of points */
+    std::vector<Point> to_points() const;
+};
+
+inline void VertexStreams::set(size_t vertex_id, const Point &point)
+{
+    x()[vertex_id] = point.x;
+    y()[vertex_id] = point.y;
+    z()[vertex_id] = point.z;
+}
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include "arena.h"
+
+const size_t Arena::BLOCK_SIZE;
+const size_t Arena::KEPT_BLOCKS;
+const size_t Arena::BLOCK_ALIGNMENT;
+
+static std::atomic<size_t> finished_allocations(0);
+static std::atomic<size_t> finished_blocks(0);
+static std::atomic<size_t> finished_block_bytes(0);
+/** Arenas of running threads, their statistics are added to `arena_stats` too */
+static std::mutex live_arenas_mutex;
+static std::vector<const Arena *> live_arenas;
+
+Arena::Arena()
+{
+    std::lock_guard<std::mutex> lock(live_arenas_mutex);
+    live_arenas.push_back(this);
+}
+
+Arena::~Arena()
+{
+    std::lock_guard<std::mutex> lock(live_arenas_mutex);
+    live_arenas.erase(std::find(live_arenas.begin(), live_arenas.end(), this));
+    for (char *block : blocks)
+    {
+        std::free(block);
+    }
+    for (void *allocation : large_allocations)
+    {
+        std::free(allocation);
+    }
+    finished_allocations += stats.allocations;
+    finished_blocks += stats.blocks;
+    finished_block_bytes += stats.block_bytes;
+}
+
+void *Arena::allocate_from_system(size_t bytes, size_t alignment)
+{
+    void *memory = nullptr;
+    if (posix_memalign(&memory, std::max(alignment, alignof(std::max_align_t)), bytes) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    ++stats.blocks;
+    stats.block_bytes += bytes;
+    return memory;
+}
+
+void *Arena::allocate(size_t bytes, size_t alignment)
+{
+    ++stats.allocations;
+    if (bytes > BLOCK_SIZE || alignment > BLOCK_ALIGNMENT)
+    {
+        large_allocations.push_back(allocate_from_system(bytes, alignment));
+        return large_allocations.back();
+    }
+    // Blocks start at BLOCK_ALIGNMENT boundary, so offset aligned inside a block gives an aligned address
+    while (current_block < blocks.size())
+    {
+        size_t start = (offset + alignment - 1) & ~(alignment - 1);
+        if (start + bytes <= BLOCK_SIZE)
+        {
+            offset = start + bytes;
+            return blocks[current_block] + start;
+        }
+        ++current_block;
+        offset = 0;
+    }
+
+    blocks.push_back(static_cast<char *>(allocate_from_system(BLOCK_SIZE, BLOCK_ALIGNMENT)));
+    current_block = blocks.size() - 1;
+    offset = bytes;
+    return blocks.back();
+}
+
+Arena::Mark Arena::mark() const
+{
+    return {current_block, offset, large_allocations.size()};
+}
+
+void Arena::rewind(const Mark &mark)
+{
+    current_block = mark.block;
+    offset = mark.offset;
+    for (size_t allocation = mark.large_allocations; allocation < large_allocations.size(); ++allocation)
+    {
+        std::free(large_allocations[allocation]);
+    }
+    large_allocations.resize(mark.large_allocations);
+    // Blocks after the current one hold nothing alive now
+    size_t kept_blocks = std::max(KEPT_BLOCKS, current_block + 1);
+    for (size_t block = kept_blocks; block < blocks.size(); ++block)
+    {
+        std::free(blocks[block]);
+    }
+    blocks.resize(std::min(blocks.size(), kept_blocks));
+}
+
+const ArenaStats &Arena::get_stats() const
+{
+    return stats;
+}
+
+Arena &thread_arena()
+{
+    thread_local Arena arena;
+    return arena;
+}
+
+ArenaStats arena_stats()
+{
+    std::lock_guard<std::mutex> lock(live_arenas_mutex);
+    ArenaStats stats;
+    stats.allocations = finished_allocations;
+    stats.blocks = finished_blocks;
+    stats.block_bytes = finished_block_bytes;
+    for (const Arena *arena : live_arenas)
+    {
+        stats.allocations += arena->get_stats().allocations;
+        stats.blocks += arena->get_stats().blocks;
+        stats.block_bytes += arena->get_stats().block_bytes;
+    }
+    return stats;
+}
@@ -1,80 +1,182 @@
-#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
 #include <iostream>
 #include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include "arena.h"
 #include "geom_utils.h"
+#include "parallel.h"
+#include "radix_sort.h"
 #include "cutter.h"
+#include "face_classifier.h"
 #include "ply.h"
+#include "save_queue.h"
 
 class PartitionResult {
 public:
     size_t triangles_crossed;
-    float x_angle;
-    float y_angle;
-    float z_angle;
+    Mat3 rotation_matrix;
     Point first_point;
     Point last_point;
 
-    PartitionResult(float x_angle, float y_angle, float z_angle) : triangles_crossed(SIZE_MAX),
-                                                                       x_angle(x_angle),
-                                                                       y_angle(y_angle),
-                                                                       z_angle(z_angle),
-                                                                       first_point({0, 0, 0}),
-                                                                       last_point({2, 3, 9}) {}
+    explicit PartitionResult(const Mat3 &rotation_matrix) : triangles_crossed(SIZE_MAX),
+                                                            rotation_matrix(rotation_matrix),
+                                                            first_point({0, 0, 0}),
+                                                            last_point({2, 3, 9}) {}
 };
 
-void build_events(const Figure &figure, std::vector<std::pair<size_t, char>> &events, const Matrix &rotation_matrix)
+/** Faces of `figure` with ids in [`first`; `last`) that form one node of partition tree */
+template<typename Index>
+class FaceRange {
+public:
+    const BasicFigure<Index> &figure;
+    Index *first;
+    Index *last;
+
+    FaceRange(const BasicFigure<Index> &figure, Index *first, Index *last) : figure(figure), first(first), last(last) {}
+    size_t size() const { return last - first; }
+};
+
+/**
+ * Nodes with less faces than this per thread are processed by one thread and get parallelism from tasks,
+ * bigger nodes close to the root split their own loops between threads too
+ */
+static const size_t MIN_FACES_PER_THREAD = (size_t) 1 << 16;
+
+/** Number of threads that split loops over a node of `face_count` faces */
+static size_t node_threads(size_t face_count)
 {
-    std::vector<float> turned_points_x;
-    turned_points_x.reserve(figure.get_vertices().size());
-    for (const Point &vertex : figure.get_vertices())
-    {
-        turned_points_x.push_back(vertex.turned(rotation_matrix).x);
-    }
-    events.reserve(figure.get_faces().size() * 2);
-    for (const std::vector<size_t> &face : figure.get_faces())
-    {
-        size_t min_vertex = 0;
-        size_t max_vertex = 1;
-        if (turned_points_x[face[1]] < turned_points_x[face[min_vertex]])
-        {
-            min_vertex = 1;
-        }
-        else {
-            max_vertex = 1;
-        }
-        if (turned_points_x[face[2]] < turned_points_x[face[min_vertex]])
-        {
-            min_vertex = 2;
-        }
-        else if (turned_points_x[face[2]] > turned_points_x[face[max_vertex]])
+    return std::max<size_t>(1, std::min(thread_count(), face_count / MIN_FACES_PER_THREAD));
+}
+
+/** Calls `body(first, last)` for contiguous ranges of [0; `size`) split between at most `threads` threads */
+static void split_between(size_t size, size_t threads, const std::function<void(size_t, size_t)> &body)
+{
+    size_t chunks = std::max<size_t>(1, std::min(threads, size / MIN_FACES_PER_THREAD));
+    parallel_for(chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+        body(size * first_chunk / chunks, size * last_chunk / chunks);
+    });
+}
+
+/** Event of 128 bits, used if vertex ids do not fit into 31 bits */
+typedef unsigned __int128 WideEvent;
+
+/**
+ * Face opens or closes at vertex `vertex_id` with turned x coordinate `x`. Event is packed into unsigned integer
+ * `Event`, so that events are sorted by x with radix sort: the highest 32 bits are sortable key of `x`,
+ * the lowest bit is 1 for closing event and vertex id is between them
+ */
+template<typename Event>
+inline Event pack_event(float x, size_t vertex_id, bool closes)
+{
+    return (Event) sortable_key(x) << (8 * sizeof(Event) - 32) | (Event) vertex_id << 1 | (Event) closes;
+}
+
+template<typename Event>
+inline size_t event_vertex(Event event)
+{
+    return (size_t) ((event >> 1) & (((Event) 1 << (8 * sizeof(Event) - 33)) - 1));
+}
+
+template<typename Event>
+inline float event_x(Event event)
+{
+    return sortable_key_value((uint32_t) (event >> (8 * sizeof(Event) - 32)));
+}
+
+/**
+ * Builds unsorted events of faces of `range` turned by `rotation_matrix`: opening event of face `i` of the range
+ * is `events[2 * i]`, closing one is `events[2 * i + 1]`
+ * `turned_points_x` are turned x coordinates of all vertices of the figure or nullptr, then only vertices
+ * of the range are turned
+ */
+template<typename Event, typename Index>
+void build_events(const FaceRange<Index> &range, const Mat3 &rotation_matrix, const float *turned_points_x,
+        size_t threads, ScratchVector<Event> &events)
+{
+    const VertexStreams &vertices = range.figure.get_vertices();
+    events.resize(range.size() * 2);
+    split_between(range.size(), threads, [&](size_t first, size_t last) {
+        for (size_t face_n = first; face_n < last; ++face_n)
         {
-            max_vertex = 2;
+            BasicFaceView<Index> face = range.figure.face(range.first[face_n]);
+            float x[3];
+            for (size_t vertex = 0; vertex < 3; ++vertex)
+            {
+                x[vertex] = turned_points_x == nullptr ? turn_coordinate(vertices[face[vertex]], rotation_matrix, 0)
+                                                       : turned_points_x[face[vertex]];
+            }
+            size_t min_vertex = 0;
+            size_t max_vertex = 1;
+            if (x[1] < x[min_vertex])
+            {
+                min_vertex = 1;
+            }
+            else {
+                max_vertex = 1;
+            }
+            if (x[2] < x[min_vertex])
+            {
+                min_vertex = 2;
+            }
+            else if (x[2] > x[max_vertex])
+            {
+                max_vertex = 2;
+            }
+            events[2 * face_n] = pack_event<Event>(x[min_vertex], face[min_vertex], false);
+            events[2 * face_n + 1] = pack_event<Event>(x[max_vertex], face[max_vertex], true);
         }
-        events.emplace_back(face[min_vertex], -1);
-        events.emplace_back(face[max_vertex], 1);
-    }
-
-    std::sort(events.begin(), events.end(), [&](const std::pair<size_t, char> &a, const std::pair<size_t, char> &b) {
-        return turned_points_x[a.first] < turned_points_x[b.first];
     });
 }
 
-inline Point rotate(size_t vertex_id, const Figure &figure, const Matrix &rotation_matrix)
+/** Sorts `events` by turned x. Sort is stable and is split between `sort_threads` threads */
+template<typename Event>
+void sort_events(ScratchVector<Event> &events, size_t sort_threads)
+{
+    ScratchVector<Event> buffer(events.size());
+    radix_sort_by_key(events.data(), buffer.data(), events.size(), sort_threads);
+}
+
+template<typename Index>
+inline Point rotate(size_t vertex_id, const BasicFigure<Index> &figure, const Mat3 &rotation_matrix)
 {
     return figure.get_vertices()[vertex_id].turned(rotation_matrix);
 }
 
-void scanline(const std::vector<std::pair<size_t, char>> & events, const Figure &figure, PartitionResult &result,
-        const Matrix &rotation_matrix)
+/** Returns true if `ctr_left` and `ctr_right` faces on the sides of a cut are balanced enough to take the cut */
+inline bool is_balanced(size_t ctr_left, size_t ctr_right)
 {
-    int ctr_intersected = 0;
-    size_t ctr_left = 0;
-    size_t ctr_right = figure.get_faces().size();
-    for (auto &p_e : events)
+    static const float NORMAL_DIVISION = 1.1;
+    return std::min(ctr_left, ctr_right) * NORMAL_DIVISION >= std::max(ctr_left, ctr_right);
+}
+
+/** Takes cut after event at vertex `vertex_id` with `ctr_intersected` crossed faces if it is better than `result` */
+template<typename Index>
+inline void update_result(PartitionResult &result, size_t ctr_intersected, size_t vertex_id,
+        const FaceRange<Index> &range, const Mat3 &rotation_matrix)
+{
+    if (ctr_intersected < result.triangles_crossed)
     {
-        size_t point = p_e.first;
-        char event_type = p_e.second;
-        if (event_type== -1)
+        result.triangles_crossed = ctr_intersected;
+        result.first_point = rotate(vertex_id, range.figure, rotation_matrix);
+        result.last_point = result.first_point;
+        result.last_point.y += 42; // just a vertical line
+    }
+}
+
+/**
+ * Scans events [`first`; `last`) starting with given counters of faces left of, right of and crossed by the line.
+ * Stops when the left part outweighs the right one, as no balanced cut can follow
+ */
+template<typename Event, typename Index>
+void scan_events(const Event *first, const Event *last, size_t ctr_left, size_t ctr_right, size_t ctr_intersected,
+        const FaceRange<Index> &range, PartitionResult &result, const Mat3 &rotation_matrix)
+{
+    for (const Event *event = first; event != last; ++event)
+    {
+        if ((*event & 1) == 0)
         { // open
             --ctr_right;
             ++ctr_intersected;
@@ -85,16 +187,9 @@ void scanline(const std::vector<std::pair<size_t, char>> & events, const Figure
             --ctr_intersected;
         }
 
-        static const float NORMAL_DIVISION = 1.1;
-        if (std::min(ctr_left, ctr_right) * NORMAL_DIVISION >= std::max(ctr_left, ctr_right))
+        if (is_balanced(ctr_left, ctr_right))
         {
-            if (ctr_intersected < result.triangles_crossed)
-            {
-                result.triangles_crossed = ctr_intersected;
-                result.first_point = rotate(point, figure, rotation_matrix);
-                result.last_point = result.first_point;
-                result.last_point.y += 42; // just a vertical line
-            }
+            update_result(result, ctr_intersected, event_vertex(*event), range, rotation_matrix);
         }
         else if (ctr_left > ctr_right)
         {
@@ -103,176 +198,606 @@ void scanline(const std::vector<std::pair<size_t, char>> & events, const Figure
     }
 }
 
-void find_partition(const Figure &base_figure, PartitionResult &best_result, std::mutex &mutex,
-        const Parameters &params)
+/**
+ * Finds the cut with the least crossed faces among balanced ones along sorted `events`
+ * With several threads events are split into chunks: counters at chunk starts are prefix sums of opening and
+ * closing events of previous chunks, then chunks are scanned in parallel and the first best cut is taken,
+ * so the result is the same as of one thread
+ */
+template<typename Event, typename Index>
+void scanline(const ScratchVector<Event> &events, const FaceRange<Index> &range,
+        PartitionResult &result, const Mat3 &rotation_matrix, size_t threads)
 {
-    float x_angle = generate_random_angle();
-    float y_angle = generate_random_angle();
-    float z_angle = generate_random_angle();
+    size_t chunks = std::max<size_t>(1, std::min(threads, events.size() / MIN_FACES_PER_THREAD));
+    if (chunks == 1)
+    {
+        scan_events(events.data(), events.data() + events.size(), 0, range.size(), 0, range, result, rotation_matrix);
+        return;
+    }
+
+    std::vector<size_t> opens_before(chunks + 1);
+    std::vector<size_t> closes_before(chunks + 1);
+    parallel_for(chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+        for (size_t chunk = first_chunk; chunk < last_chunk; ++chunk)
+        {
+            size_t closes = 0;
+            for (size_t i = events.size() * chunk / chunks; i < events.size() * (chunk + 1) / chunks; ++i)
+            {
+                closes += events[i] & 1;
+            }
+            closes_before[chunk + 1] = closes;
+            opens_before[chunk + 1] = events.size() * (chunk + 1) / chunks - events.size() * chunk / chunks - closes;
+        }
+    });
+    std::partial_sum(opens_before.begin(), opens_before.end(), opens_before.begin());
+    std::partial_sum(closes_before.begin(), closes_before.end(), closes_before.begin());
+
+    std::vector<PartitionResult> chunk_results(chunks, result);
+    parallel_for(chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+        for (size_t chunk = first_chunk; chunk < last_chunk; ++chunk)
+        {
+            scan_events(events.data() + events.size() * chunk / chunks,
+                    events.data() + events.size() * (chunk + 1) / chunks, closes_before[chunk],
+                    range.size() - opens_before[chunk], opens_before[chunk] - closes_before[chunk], range,
+                    chunk_results[chunk], rotation_matrix);
+        }
+    });
+    for (const PartitionResult &chunk_result : chunk_results)
+    {
+        if (chunk_result.triangles_crossed < result.triangles_crossed)
+        {
+            result = chunk_result;
+        }
+    }
+}
+
+static const size_t MAX_HISTOGRAM_BINS = (size_t) 1 << 16;
+static const size_t EVENTS_PER_BIN = 32;
+
+/**
+ * Same as `scanline`, but `events` may be unsorted and are sorted only where the best cut may be
+ * Events are counted in a histogram over turned x. Counters of the scanline are known exactly at bin borders,
+ * crossings inside a bin are not less than at its start minus its closing events. Only bins where a balanced cut
+ * can be and where this bound does not exceed crossings reachable at a balanced border are sorted and scanned,
+ * so the result is the same as of `scanline` in linear time. Returns number of events that were sorted
+ */
+template<typename Event, typename Index>
+size_t histogram_scanline(const ScratchVector<Event> &events, const FaceRange<Index> &range,
+        PartitionResult &result, const Mat3 &rotation_matrix, size_t sort_threads)
+{
+    if (events.empty())
+    {
+        return 0;
+    }
+    float min_x = event_x(events[0]);
+    float max_x = min_x;
+    for (Event event : events)
+    {
+        min_x = std::min(min_x, event_x(event));
+        max_x = std::max(max_x, event_x(event));
+    }
+    size_t bins = std::max<size_t>(1, std::min(MAX_HISTOGRAM_BINS, events.size() / EVENTS_PER_BIN));
+    float scale = max_x > min_x ? bins / (max_x - min_x) : 0;
+    // Monotone in x, so events of a bin go after events of previous bins in sorted order
+    auto bin_of = [&](Event event) {
+        return std::min(bins - 1, (size_t) ((event_x(event) - min_x) * scale));
+    };
+
+    ScratchVector<size_t> opens(bins);
+    ScratchVector<size_t> closes(bins);
+    for (Event event : events)
+    {
+        ++((event & 1) == 0 ? opens : closes)[bin_of(event)];
+    }
+
+    size_t best_reachable = SIZE_MAX;
+    size_t ctr_intersected = 0;
+    size_t ctr_left = 0;
+    size_t ctr_right = range.size();
+    for (size_t bin = 0; bin < bins; ++bin)
+    {
+        ctr_left += closes[bin];
+        ctr_right -= opens[bin];
+        ctr_intersected = ctr_intersected + opens[bin] - closes[bin];
+        if (is_balanced(ctr_left, ctr_right))
+        {
+            best_reachable = std::min(best_reachable, ctr_intersected);
+        }
+    }
 
-    Matrix rotation_matrix = get_rotation_matrix(x_angle, y_angle, z_angle);
+    // Division goes from right-heavy to left-heavy, so a bin may have balanced cut only if it neither ends
+    // right-heavy nor starts left-heavy. Counters are replaced with their values at the start of every bin
+    ScratchVector<char> refine(bins);
+    size_t opened = 0;
+    size_t closed = 0;
+    for (size_t bin = 0; bin < bins; ++bin)
+    {
+        size_t start_left = closed;
+        size_t start_right = range.size() - opened;
+        size_t start_intersected = opened - closed;
+        size_t end_left = start_left + closes[bin];
+        size_t end_right = start_right - opens[bin];
+        bool may_balance = (is_balanced(end_left, end_right) || end_left > end_right) &&
+                           (is_balanced(start_left, start_right) || start_left < start_right);
+        size_t lower_bound = start_intersected > closes[bin] ? start_intersected - closes[bin] : 0;
+        refine[bin] = may_balance && lower_bound <= best_reachable;
 
-    std::vector<std::pair<size_t, char>> events;
-    build_events(base_figure, events, rotation_matrix);
+        opened += opens[bin];
+        closed += closes[bin];
+        opens[bin] = opened - opens[bin];
+        closes[bin] = closed - closes[bin];
+    }
 
-    PartitionResult result = PartitionResult(x_angle, y_angle, z_angle);
-    scanline(events, base_figure, result, rotation_matrix);
+    ScratchVector<Event> refined;
+    for (Event event : events)
+    {
+        if (refine[bin_of(event)])
+        {
+            refined.push_back(event);
+        }
+    }
+    sort_events(refined, sort_threads);
 
-    mutex.lock();
-    if (best_result.triangles_crossed > result.triangles_crossed)
+    size_t current_bin = SIZE_MAX;
+    for (Event event : refined)
     {
-        best_result = result;
+        size_t bin = bin_of(event);
+        if (bin != current_bin)
+        {
+            current_bin = bin;
+            ctr_left = closes[bin];
+            ctr_right = range.size() - opens[bin];
+            ctr_intersected = opens[bin] - closes[bin];
+        }
+        if ((event & 1) == 0)
+        {
+            --ctr_right;
+            ++ctr_intersected;
+        }
+        else
+        {
+            ++ctr_left;
+            --ctr_intersected;
+        }
+        if (is_balanced(ctr_left, ctr_right))
+        {
+            update_result(result, ctr_intersected, event_vertex(event), range, rotation_matrix);
+        }
     }
-    mutex.unlock();
+    return refined.size();
 }
 
-void assign_clusters(Figure &figure, Figure &new_figure, const Line &line,
-        std::vector<size_t> &left, std::vector<size_t> &right)
+/**
+ * Finds the best cut along direction of `result.rotation_matrix` and stores it in `result`
+ * In CUT_SEARCH_COMPARE mode both searches are added to `comparison` unless it is nullptr
+ */
+template<typename Event, typename Index>
+void try_direction(const FaceRange<Index> &range, PartitionResult &result, const float *turned_points_x,
+        size_t threads, const Parameters &params, CutSearchComparison *comparison)
 {
-    static const float DIF = 5;
-    std::vector<std::vector<size_t>> new_clusters;
+    ArenaScope scope;
+    const Mat3 &rotation_matrix = result.rotation_matrix;
+    ScratchVector<Event> events;
+    build_events(range, rotation_matrix, turned_points_x, threads, events);
 
-    for (const std::vector<size_t> &cluster : figure.get_clusters())
+    if (params.cut_search == CUT_SEARCH_EXACT)
+    {
+        sort_events(events, threads);
+        scanline(events, range, result, rotation_matrix, threads);
+    }
+    else
     {
-        size_t left_side = 0;
-        size_t right_side = 0;
-        for (size_t face_id : cluster)
+        PartitionResult exact = result;
+        size_t sorted_events = histogram_scanline(events, range, result, rotation_matrix, threads);
+        if (params.cut_search == CUT_SEARCH_COMPARE && comparison != nullptr)
         {
-            const std::vector<size_t> &face = new_figure.get_faces()[face_id];
-            Position position = line_triangle_position(line, face, new_figure);
-            if (position == LEFT)
+            sort_events(events, threads);
+            scanline(events, range, exact, rotation_matrix, threads);
+            ++comparison->directions;
+            comparison->same_crossings += result.triangles_crossed == exact.triangles_crossed;
+            if (result.triangles_crossed != SIZE_MAX && exact.triangles_crossed != SIZE_MAX)
             {
-                ++left_side;
-            }
-            else if (position == RIGHT)
-            {
-                ++right_side;
+                comparison->histogram_crossed += result.triangles_crossed;
+                comparison->exact_crossed += exact.triangles_crossed;
             }
+            comparison->events += events.size();
+            comparison->sorted_events += sorted_events;
         }
+    }
+}
 
-        // At least DIF:1 division
-        if (std::min(left_side, right_side) * DIF < std::max(left_side, right_side))
+/** Chooses size of packed events: 64 bits leave 31 bits for vertex id */
+template<typename Index>
+void find_partition(const FaceRange<Index> &range, PartitionResult &result, const float *turned_points_x,
+        size_t threads, const Parameters &params, CutSearchComparison *comparison)
+{
+    if (range.figure.get_vertices().size() <= ((size_t) 1 << 31))
+    {
+        try_direction<uint64_t>(range, result, turned_points_x, threads, params, comparison);
+    }
+    else
+    {
+        try_direction<WideEvent>(range, result, turned_points_x, threads, params, comparison);
+    }
+}
+
+/**
+ * Tries `params.parts` directions generated from `seed` in parallel and returns the best of them
+ * Ties are won by the first direction, so the result does not depend on the order tries finish in
+ */
+template<typename Index>
+PartitionResult find_best_partition(const FaceRange<Index> &range, const Parameters &params, uint64_t seed,
+                                    CutSearchComparison *comparison)
+{
+    std::mt19937_64 generator(seed);
+    std::vector<Mat3> rotation_matrices = generate_cut_rotations(params.parts, generator);
+    std::vector<PartitionResult> tries(rotation_matrices.begin(), rotation_matrices.end());
+
+    // Range with at least half as many faces as there are vertices uses most of them, so x streams for all directions
+    // are turned at once in one pass over vertices. Otherwise every try turns only vertices of the range
+    ArenaScope scope;
+    size_t threads = node_threads(range.size());
+    const VertexStreams &vertices = range.figure.get_vertices();
+    std::vector<float, ArenaAllocator<float, STREAM_ALIGNMENT>> turned_points_x;
+    std::vector<float *> turned(params.parts, nullptr);
+    if (2 * range.size() >= vertices.size())
+    {
+        turned_points_x.resize(params.parts * vertices.padded_size());
+        for (size_t try_n = 0; try_n < params.parts; ++try_n)
         {
-            for (size_t face_id : cluster)
-            {
-                (left_side > right_side ? left : right).push_back(face_id);
-            }
+            turned[try_n] = turned_points_x.data() + try_n * vertices.padded_size();
+        }
+        turn_coordinate(vertices, rotation_matrices.data(), params.parts, 0, turned.data(), threads);
+    }
+
+    // Tries already run in parallel, so every try gets its share of threads of the node
+    size_t try_threads = (threads + params.parts - 1) / params.parts;
+    TaskGroup tries_group;
+    for (size_t try_n = 0; try_n < params.parts; ++try_n)
+    {
+        tries_group.run([&, try_n]() {
+            find_partition(range, tries[try_n], turned[try_n], try_threads, params, comparison);
+        });
+    }
+    tries_group.wait();
 
-            new_clusters.push_back(cluster);
+    PartitionResult best_result = tries[0];
+    for (const PartitionResult &result : tries)
+    {
+        if (result.triangles_crossed < best_result.triangles_crossed)
+        {
+            best_result = result;
         }
     }
+    return best_result;
+}
 
-    new_figure.set_clusters(new_clusters);
+static Cut make_cut(const PartitionResult &result)
+{
+    return Cut(result.rotation_matrix, Line(result.first_point, result.last_point));
 }
 
-// Assigns points that doesn't belong to any cluster
-void assign_lone(const Figure &figure, const Line &line,
-        std::vector<size_t> &cross, std::vector<size_t> &left, std::vector<size_t> &right)
+uint64_t node_seed(uint64_t seed, const std::string &node_name)
 {
-    for (size_t face_id = 0; face_id < figure.get_faces().size(); ++face_id)
+    // splitmix64 finalizer over every byte of the name
+    uint64_t hash = seed;
+    for (char symbol : node_name)
     {
-        if (figure.get_face2cluster()[face_id] != -1)
+        hash = (hash ^ (unsigned char) symbol) + 0x9e3779b97f4a7c15ull;
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+        hash ^= hash >> 31;
+    }
+    return hash;
+}
+
+template<typename Index>
+Cut find_cut(const BasicFigure<Index> &figure, const Parameters &params, uint64_t seed,
+             CutSearchComparison *comparison)
+{
+    std::vector<Index> faces(figure.face_count());
+    std::iota(faces.begin(), faces.end(), 0);
+    return make_cut(find_best_partition(FaceRange<Index>(figure, faces.data(), faces.data() + faces.size()), params,
+            seed, comparison));
+}
+
+Cut::Cut(const Vec3 &normal, float offset) : normal(normal), offset(offset) {}
+
+// Line position of turned point is a * (point * column 0) + b * (point * column 1) + c,
+// that is the same linear function of the point itself
+Cut::Cut(const Mat3 &rotation_matrix, const Line &line)
+    : normal({{line.a * rotation_matrix.matrix[0][0] + line.b * rotation_matrix.matrix[0][1],
+               line.a * rotation_matrix.matrix[1][0] + line.b * rotation_matrix.matrix[1][1],
+               line.a * rotation_matrix.matrix[2][0] + line.b * rotation_matrix.matrix[2][1]}}),
+      offset(line.c) {}
+
+Position Cut::face_position(const std::vector<Point> &face) const
+{
+    return polygon_position(face, [this](const Point &point) { return point_distance(point); });
+}
+
+template<typename Index>
+Position Cut::face_position(const BasicFigure<Index> &figure, size_t face_id) const
+{
+    const VertexStreams &vertices = figure.get_vertices();
+    return polygon_position(figure.face(face_id), [&](size_t vertex_id) {
+        return point_distance(vertices[vertex_id]);
+    });
+}
+
+/**
+ * Moves every face of cluster that is divided at least DIF:1 to the side of its majority
+ * Faces of other clusters keep their own positions, so such clusters are split between both parts.
+ * `positions` are positions of faces of `range` in its order
+ */
+template<typename Index>
+void assign_clusters(const FaceRange<Index> &range, PackedPositions &positions)
+{
+    static const float DIF = 5;
+    const std::vector<int> &face2cluster = range.figure.get_face2cluster();
+    // Number of faces on the left and on the right side for every cluster met in the range
+    std::unordered_map<int, std::pair<size_t, size_t>, std::hash<int>, std::equal_to<int>,
+            ArenaAllocator<std::pair<const int, std::pair<size_t, size_t>>>> cluster_sides;
+
+    for (size_t face = 0; face < range.size(); ++face)
+    {
+        int cluster = face2cluster[range.first[face]];
+        if (cluster != -1 && positions.get(face) != CROSS)
         {
-            continue;
+            std::pair<size_t, size_t> &sides = cluster_sides[cluster];
+            ++(positions.get(face) == LEFT ? sides.first : sides.second);
         }
-        const std::vector<size_t> &face = figure.get_faces()[face_id];
-        Position position = line_triangle_position(line, face, figure);
-        if (position == LEFT)
+    }
+
+    for (size_t face = 0; face < range.size(); ++face)
+    {
+        int cluster = face2cluster[range.first[face]];
+        if (cluster == -1)
         {
-            left.push_back(face_id);
+            continue;
         }
-        else if (position == CROSS)
+        auto sides = cluster_sides.find(cluster);
+        if (sides == cluster_sides.end())
         {
-            cross.push_back(face_id);
+            continue;
         }
-        else
+        size_t left_side = sides->second.first;
+        size_t right_side = sides->second.second;
+        // At least DIF:1 division
+        if (std::min(left_side, right_side) * DIF < std::max(left_side, right_side))
         {
-            right.push_back(face_id);
+            positions.set(face, left_side > right_side ? LEFT : RIGHT);
         }
     }
 }
 
-void assign_cross(std::vector<size_t> &cross, std::vector<size_t> &left, std::vector<size_t> &right)
+/**
+ * Number of crossed faces given to the left side if every crossed face in turn goes to the side that has less faces
+ * at the moment, and to the right one on a tie
+ */
+static size_t cross_to_left(size_t left, size_t right, size_t cross)
+{
+    size_t difference = left < right ? right - left : left - right;
+    size_t to_smaller = std::min(cross, difference);
+    // After the sides become equal crossed faces alternate starting with the right side
+    return (left < right ? to_smaller : 0) + (cross - to_smaller) / 2;
+}
+
+/**
+ * Reorders faces of `range` by their `positions`, so that faces of the left part go first
+ * Crossed faces are put between left and right ones, and as many of them as `cross_to_left` says go to the left part.
+ * Chunks of words of codes count their faces of every position by bit tricks, prefix sums of the counts give every
+ * chunk its place in all three groups, then chunks are scattered to a buffer and copied back in parallel.
+ * Order of faces inside the groups is kept. Returns the first face of the right part
+ */
+template<typename Index>
+static Index *compact_faces(const FaceRange<Index> &range, const PackedPositions &positions, size_t threads)
 {
-    while (!cross.empty())
+    size_t chunks = std::max<size_t>(1, std::min(threads, range.size() / MIN_FACES_PER_THREAD));
+    std::vector<size_t> before[3];
+    for (std::vector<size_t> &counts : before)
     {
-        if (left.size() < right.size())
+        counts.resize(chunks + 1);
+    }
+    auto chunk_words = [&](size_t chunk) {
+        return positions.word_count() * chunk / chunks;
+    };
+    parallel_for(chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+        for (size_t chunk = first_chunk; chunk < last_chunk; ++chunk)
         {
-            left.push_back(cross.back());
+            for (Position position : {LEFT, RIGHT, CROSS})
+            {
+                before[position][chunk + 1] = positions.count(chunk_words(chunk), chunk_words(chunk + 1), position);
+            }
         }
-        else
+    });
+    for (std::vector<size_t> &counts : before)
+    {
+        std::partial_sum(counts.begin(), counts.end(), counts.begin());
+    }
+
+    size_t left_count = before[LEFT][chunks];
+    size_t cross_count = before[CROSS][chunks];
+    ScratchVector<Index> compacted(range.size());
+    parallel_for(chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+        for (size_t chunk = first_chunk; chunk < last_chunk; ++chunk)
         {
-            right.push_back(cross.back());
+            size_t next[3];
+            next[LEFT] = before[LEFT][chunk];
+            next[CROSS] = left_count + before[CROSS][chunk];
+            next[RIGHT] = left_count + cross_count + before[RIGHT][chunk];
+            size_t first_face = chunk_words(chunk) * PackedPositions::FACES_PER_WORD;
+            size_t last_face = std::min(range.size(), chunk_words(chunk + 1) * PackedPositions::FACES_PER_WORD);
+            for (size_t face = first_face; face < last_face; ++face)
+            {
+                compacted[next[positions.get(face)]++] = range.first[face];
+            }
         }
-        cross.pop_back();
-    }
+    });
+    split_between(range.size(), threads, [&](size_t first, size_t last) {
+        std::copy(compacted.begin() + first, compacted.begin() + last, range.first + first);
+    });
+    return range.first + left_count + cross_to_left(left_count, before[RIGHT][chunks], cross_count);
+}
+
+/**
+ * Reorders faces of `range` by the cut, so that faces of the left part go first
+ * Returns the first face of the right part
+ */
+template<typename Index>
+static Index *do_partition(const PartitionResult &result, const FaceRange<Index> &range)
+{
+    Cut cut = make_cut(result);
+    ArenaScope scope;
+    size_t threads = node_threads(range.size());
+    PackedPositions positions = classify_faces(range.figure, range.first, range.size(), cut, threads);
+    assign_clusters(range, positions);
+    return compact_faces(range, positions, threads);
+}
+
+static const size_t SAVE_THREADS = 2;
+
+static bool is_leaf(size_t face_count, int depth, const Parameters &params)
+{
+    return depth >= params.depth || face_count <= params.acceptable_size;
 }
 
-std::pair<Figure, Figure> do_partition(const PartitionResult &result, Figure base_figure,
-        const std::string &filename, const Parameters &params)
+/** State shared by all nodes of one partition tree */
+template<typename Index>
+class PartitionContext {
+public:
+    const Parameters &params;
+    SaveQueue<Index> &save_queue;
+    CutSearchComparison &comparison;
+    /**
+     * Leaves with their names, collected by all threads in any order
+     * Save queue shares the figures until they are saved, so they are not copied
+     */
+    std::vector<std::pair<std::string, std::shared_ptr<BasicFigure<Index>>>> leaves;
+    std::mutex leaves_mutex;
+
+    PartitionContext(const Parameters &params, SaveQueue<Index> &save_queue, CutSearchComparison &comparison)
+        : params(params), save_queue(save_queue), comparison(comparison) {}
+};
+
+/** Adds leaf `figure` to leaves of `context` and hands it over to the save queue if subfigures are saved */
+template<typename Index>
+static void collect_leaf(BasicFigure<Index> figure, const std::string &save_filename,
+                         PartitionContext<Index> &context)
 {
-    Figure figure = base_figure.turned(result.x_angle, result.y_angle, result.z_angle);
-    std::vector<size_t> left;
-    std::vector<size_t> right;
-    std::vector<size_t> cross;
+    std::shared_ptr<BasicFigure<Index>> leaf = std::make_shared<BasicFigure<Index>>(std::move(figure));
+    context.leaves_mutex.lock();
+    context.leaves.emplace_back(save_filename, leaf);
+    context.leaves_mutex.unlock();
+    if (context.params.save_partition)
+    {
+        context.save_queue.push(std::move(leaf),
+                save_filename + (context.params.compress_output ? ".mesh" : ".ply"));
+    }
+}
 
-    left.reserve(figure.get_faces().size() / 2 + result.triangles_crossed);
-    right.reserve(figure.get_faces().size() / 2 + result.triangles_crossed);
-    cross.reserve(result.triangles_crossed);
+template<typename Index>
+static void partition_node(FaceRange<Index> range, int depth, const std::string &save_filename,
+                           PartitionContext<Index> &context);
 
-    Line line(result.first_point, result.last_point);
+/** Divides faces of `range` into two ranges and partitions them as tasks of the thread pool */
+template<typename Index>
+static void partition_children(const FaceRange<Index> &range, int depth, const std::string &save_filename,
+                               PartitionContext<Index> &context)
+{
+    PartitionResult best_result = find_best_partition(range, context.params,
+            node_seed(context.params.seed, save_filename), &context.comparison);
+    Index *middle = do_partition(best_result, range);
 
-    assign_clusters(base_figure, figure, line, left, right);
-    assign_lone(figure, line, cross, left, right);
-    assign_cross(cross, left, right);
+    // Smaller child waits in the queue of this thread and is stolen by idle workers, larger one is partitioned
+    // right away, so the biggest pending subtrees are taken first
+    FaceRange<Index> left(range.figure, range.first, middle);
+    FaceRange<Index> right(range.figure, middle, range.last);
+    bool left_is_smaller = left.size() < right.size();
+    const FaceRange<Index> &smaller = left_is_smaller ? left : right;
+    const FaceRange<Index> &larger = left_is_smaller ? right : left;
+    std::string smaller_filename = save_filename + (left_is_smaller ? "_l" : "_r");
+    std::string larger_filename = save_filename + (left_is_smaller ? "_r" : "_l");
 
-    return { Figure(base_figure, left), Figure(base_figure, right) };
+    TaskGroup children_group;
+    children_group.run([&]() {
+        partition_node(smaller, depth + 1, smaller_filename, context);
+    });
+    partition_node(larger, depth + 1, larger_filename, context);
+    children_group.wait();
 }
 
-void partition(const Figure &figure,
-               int depth,
-               const std::string &save_filename,
-               std::vector<Figure> &division,
-               std::mutex &vector_mutex,
-               const Parameters &params)
+/** Same as `partition`, but for a node given by range of faces. Subfigure is built only if the node is a leaf */
+template<typename Index>
+static void partition_node(FaceRange<Index> range, int depth, const std::string &save_filename,
+                           PartitionContext<Index> &context)
 {
-    std::cout << save_filename << ' ' << figure.get_faces().size() << std::endl;
-    if (depth >= params.depth || figure.get_faces().size() <= params.acceptable_size)
+    std::cout << save_filename << ' ' << range.size() << std::endl;
+    if (is_leaf(range.size(), depth, context.params))
     {
-        if (params.save_partition)
-        {
-            save_figure(figure, save_filename + ".ply");
-        }
-        vector_mutex.lock();
-        division.push_back(figure);
-        vector_mutex.unlock();
+        collect_leaf(BasicFigure<Index>(range.figure, std::vector<Index>(range.first, range.last)), save_filename,
+                context);
         return;
     }
+    partition_children(range, depth, save_filename, context);
+}
 
-    PartitionResult best_result = PartitionResult(-1, -1, -1);
-
-    std::mutex mutex;
-    std::vector<std::thread> threads(params.parts - 1);
-    for (size_t try_n = 0; try_n < params.parts - 1; ++try_n)
+template<typename Index>
+void partition(const BasicFigure<Index> &figure,
+               int depth,
+               const std::string &save_filename,
+               std::vector<BasicFigure<Index>> &division,
+               std::mutex &vector_mutex,
+               const Parameters &params,
+               CutSearchComparison &comparison)
+{
+    SaveQueue<Index> save_queue(params.save_partition ? SAVE_THREADS : 0, params);
+    PartitionContext<Index> context(params, save_queue, comparison);
+    std::cout << save_filename << ' ' << figure.face_count() << std::endl;
+    if (is_leaf(figure.face_count(), depth, params))
     {
-        threads[try_n] = std::thread(find_partition, std::ref(figure), std::ref(best_result), std::ref(mutex),
-                std::ref(params));
+        collect_leaf(figure, save_filename, context);
     }
-    find_partition(figure, best_result, mutex, params);
-    for (std::thread &thread : threads)
+    else
     {
-        thread.join();
+        // The only array of face ids for the whole tree, every node reorders its own range of it
+        std::vector<Index> faces(figure.face_count());
+        std::iota(faces.begin(), faces.end(), 0);
+        partition_children(FaceRange<Index>(figure, faces.data(), faces.data() + faces.size()), depth,
+                save_filename, context);
     }
+    save_queue.finish();
 
-    std::pair<Figure, Figure> left_right = do_partition(best_result, figure, save_filename, params);
-
-    std::thread left_thread = std::thread(partition, std::ref(left_right.first), depth + 1,
-            save_filename + "_l",
-            std::ref(division), 
-            std::ref(vector_mutex),
-            std::ref(params));
-    partition(left_right.second, depth + 1, save_filename + "_r",
-            division, vector_mutex, params);
+    // Leaves are added in the order of their names, so that division does not depend on scheduling of threads
+    std::sort(context.leaves.begin(), context.leaves.end(),
+            [](const std::pair<std::string, std::shared_ptr<BasicFigure<Index>>> &first,
+               const std::pair<std::string, std::shared_ptr<BasicFigure<Index>>> &second) {
+        return first.first < second.first;
+    });
+    // Saving threads have dropped their references in `finish`, leaves are owned here only
+    vector_mutex.lock();
+    for (std::pair<std::string, std::shared_ptr<BasicFigure<Index>>> &leaf : context.leaves)
+    {
+        division.push_back(std::move(*leaf.second));
+    }
+    vector_mutex.unlock();
+}
 
-    left_thread.join();
+void CutSearchComparison::print() const
+{
+    std::cout << "Histogram cut search found the same crossings as exact one in " << same_crossings << " of "
+              << directions << " directions, crossings in total: " << histogram_crossed << " histogram, "
+              << exact_crossed << " exact, " << sorted_events << " of " << events << " events sorted" << std::endl;
 }
+
+template Cut find_cut(const Figure32 &figure, const Parameters &params, uint64_t seed,
+                      CutSearchComparison *comparison);
+template Cut find_cut(const Figure &figure, const Parameters &params, uint64_t seed, CutSearchComparison *comparison);
+template Position Cut::face_position(const Figure32 &figure, size_t face_id) const;
+template Position Cut::face_position(const Figure &figure, size_t face_id) const;
+template void partition(const Figure32 &figure, int depth, const std::string &save_filename,
+                        std::vector<Figure32> &division, std::mutex &vector_mutex, const Parameters &params,
+                        CutSearchComparison &comparison);
+template void partition(const Figure &figure, int depth, const std::string &save_filename,
+                        std::vector<Figure> &division, std::mutex &vector_mutex, const Parameters &params,
+                        CutSearchComparison &comparison);
@@ -6,9 +6,16 @@
 #include "integration.h"
 #include "cutter.h"
 #include "interesting.h"
+#include "figure_cache.h"
+#include "out_of_core.h"
+#include "arena.h"
+#include "turn_kernels.h"
+#include <algorithm>
 #include <vector>
 #include <mutex>
 #include <fstream>
+#include <iostream>
+#include <stdexcept>
 
 long get_current_time() {
     return std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -16,16 +23,117 @@ long get_current_time() {
     ).count();
 }
 
-void multi_thread_executor(const std::string& filename, const std::string& save_filename, const Parameters& params)
+static std::vector<Figure> take_figures(std::vector<Figure> &division)
 {
-    long start_time = get_current_time();
-    Figure figure = read_mesh(filename);
+    return std::move(division);
+}
+
+// Parametrizer takes figures with size_t indices, so subfigures with 32-bit indices are widened.
+// Every subfigure is freed right after it is widened, so the division is never held twice
+static std::vector<Figure> take_figures(std::vector<Figure32> &division)
+{
+    std::vector<Figure> figures;
+    figures.reserve(division.size());
+    while (!division.empty())
+    {
+        figures.emplace_back(division.back());
+        division.pop_back();
+    }
+    std::reverse(figures.begin(), figures.end());
+    return figures;
+}
+
+// Runs everything after partition is done, `division` is taken by the parametrizer
+template<typename Index>
+static void run_parametrization(std::vector<BasicFigure<Index>> &division, long start_time,
+                                const std::string &output_filename, const Parameters &params)
+{
+    Parametrizer parametrizer;
+    ParametrizedFigure result = parametrizer.parametrize(take_figures(division));
+
+    save_figure(result, output_filename, params);
+
+    long now = get_current_time();
+    float time_calc = (float) (now - start_time) / 1000;
+
+    std::cout << "Calculated in " << time_calc << " seconds" << std::endl;
+}
+
+// Inserts `suffix` before extension of `filename`, "out.ply" and "_l_r" give "out_l_r.ply"
+static std::string part_filename(const std::string &filename, const std::string &suffix)
+{
+    size_t dot = filename.rfind('.');
+    if (dot == std::string::npos || filename.find('/', dot) != std::string::npos)
+    {
+        return filename + suffix;
+    }
+    return filename.substr(0, dot) + suffix + filename.substr(dot);
+}
+
+// Runs everything after figure with its clusters is ready
+template<typename Index>
+static void run_partition(const BasicFigure<Index> &figure, long start_time, const std::string &save_filename,
+                          const Parameters &params)
+{
+    if (params.benchmark_kernels)
+    {
+        benchmark_turn_kernels(figure.get_vertices());
+    }
+    long partition_start_time = get_current_time();
+    std::vector<BasicFigure<Index>> division;
+    std::mutex mutex;
+    CutSearchComparison comparison;
+    partition(figure, 0, save_filename, division, mutex, params, comparison);
+    if (params.cut_search == CUT_SEARCH_COMPARE)
+    {
+        comparison.print();
+    }
+
+    long partition_time = get_current_time();
+    std::cout << "Partition done in " << (float) (partition_time - partition_start_time) / 1000 << std::endl;
+    // Without arenas every scratch allocation would be a separate call to the global allocator
+    ArenaStats stats = arena_stats();
+    std::cout << "Scratch allocations: " << stats.allocations << ", taken from system in " << stats.blocks
+              << " blocks of " << stats.block_bytes / (1 << 20) << " MB in total" << std::endl;
+
+    run_parametrization(division, start_time, params.output_filename, params);
+}
+
+// Runs everything with vertex and face ids of type `Index`
+template<typename Index>
+static void run_executor(const std::string &filename, const std::string &save_filename, long start_time,
+                         const Parameters &params)
+{
+    if (needs_out_of_core(filename, params))
+    {
+        // Every part is parametrized into its own output before the next one is loaded
+        out_of_core_partition<Index>(filename, save_filename, params,
+                [&](std::vector<BasicFigure<Index>> &division, const std::string &part_suffix) {
+            std::string output_filename = part_filename(params.output_filename, part_suffix);
+            std::cout << "Partition of part " << output_filename << " done in "
+                      << (float) (get_current_time() - start_time) / 1000 << std::endl;
+            run_parametrization(division, start_time, output_filename, params);
+        });
+        return;
+    }
+
+    std::string cache_filename = filename + ".cache";
+    if (params.use_cache && cache_matches(cache_filename, filename, params.clustering_to_string()))
+    {
+        BasicFigure<Index> figure = read_figure_cache<Index>(cache_filename);
+        std::cout << "Read mesh with " << figure.get_clusters().size() << " clusters from cache "
+                  << cache_filename << " in " << (float) (get_current_time() - start_time) / 1000 << std::endl;
+        run_partition(figure, start_time, save_filename, params);
+        return;
+    }
+
+    BasicFigure<Index> figure = read_mesh<Index>(filename);
     std::cout << "Read mesh " << filename << std::endl;
 
     long read_mesh_time = get_current_time();
     if (params.clusterization)
     {
-        figure.set_clusters(divide_interesting(figure, params));
+        figure.set_clusters(divide_interesting(figure, params, params.seed));
         std::cout << "Found " << figure.get_clusters().size() << " clusters" << std::endl;
         for (const auto &cluster : figure.get_clusters())
         {
@@ -37,21 +145,35 @@ void multi_thread_executor(const std::string& filename, const std::string& save_
     {
         std::cout << "Clusterization done in " << (float) (cluster_time - read_mesh_time) / 1000 << std::endl;
     }
+    if (params.use_cache)
+    {
+        // Cache only speeds up next runs, so the run goes on without it, e.g. in a read-only directory
+        try
+        {
+            write_figure_cache(cache_filename, filename, params.clustering_to_string(), figure);
+        }
+        catch (const std::exception &error)
+        {
+            std::cerr << "Warning: cache " << cache_filename << " is not written: " << error.what() << std::endl;
+        }
+    }
 
-    std::vector<Figure> division;
-    std::mutex mutex;
-    partition(figure, 0, save_filename, division, mutex, params);
-
-    long partition_time = get_current_time();
-    std::cout << "Partition done in " << (float) (partition_time - cluster_time) / 1000 << std::endl;
-
-    Parametrizer parametrizer;
-    ParametrizedFigure result = parametrizer.parametrize(division);
-
-    save_figure(result, params.output_filename);
-
-    long now = get_current_time();
-    float time_calc = (float) (now - start_time) / 1000;
+    run_partition(figure, start_time, save_filename, params);
+}
 
-    std::cout << "Calculated in " << time_calc << " seconds" << std::endl;
+void multi_thread_executor(const std::string& filename, const std::string& save_filename, const Parameters& params)
+{
+    long start_time = get_current_time();
+    std::cout << "Cut directions seed: " << params.seed << std::endl;
+    size_t vertex_count;
+    size_t face_count;
+    // Meshes that fit into 32-bit ids are processed with half-size indices
+    if (read_mesh_size(filename, vertex_count, face_count) && Figure32::can_index(vertex_count, face_count))
+    {
+        run_executor<uint32_t>(filename, save_filename, start_time, params);
+    }
+    else
+    {
+        run_executor<size_t>(filename, save_filename, start_time, params);
+    }
 }
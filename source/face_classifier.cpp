@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <vector>
+#include "face_classifier.h"
+#include "parallel.h"
+
+const size_t PackedPositions::FACES_PER_WORD;
+const uint64_t PackedPositions::PADDING;
+
+/** Words shorter than this in total are not worth a thread */
+static const size_t MIN_WORDS = (size_t) 1 << 11;
+static const uint64_t LOW_BITS = 0x5555555555555555ull;
+
+PackedPositions::PackedPositions(size_t face_count)
+    : words((face_count + FACES_PER_WORD - 1) / FACES_PER_WORD, ~(uint64_t) 0), face_count(face_count) {}
+
+size_t PackedPositions::count(size_t first_word, size_t last_word, Position position) const
+{
+    // Code equals `position` iff both its bits are equal to bits of the pattern
+    uint64_t pattern = LOW_BITS * (uint64_t) position;
+    size_t result = 0;
+    for (size_t word_id = first_word; word_id < last_word; ++word_id)
+    {
+        uint64_t difference = words[word_id] ^ pattern;
+        result += __builtin_popcountll(~(difference | (difference >> 1)) & LOW_BITS);
+    }
+    return result;
+}
+
+/** Code of face with signed distances of vertices given by `distance(vertex_id)`, as of `Cut::face_position` */
+template<typename Index, typename Distance>
+static inline uint64_t face_code(const BasicFaceView<Index> &face, const Distance &distance)
+{
+    return polygon_position(face, distance);
+}
+
+template<typename Index, typename Distance>
+static void fill_codes(const BasicFigure<Index> &figure, const Index *faces, size_t max_threads,
+                       const Distance &distance, PackedPositions &positions)
+{
+    size_t chunks = std::max<size_t>(1, std::min(max_threads, positions.word_count() / MIN_WORDS));
+    parallel_for(chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+        size_t first_word = positions.word_count() * first_chunk / chunks;
+        size_t last_word = positions.word_count() * last_chunk / chunks;
+        for (size_t word_id = first_word; word_id < last_word; ++word_id)
+        {
+            size_t first_face = word_id * PackedPositions::FACES_PER_WORD;
+            size_t last_face = std::min(positions.size(), first_face + PackedPositions::FACES_PER_WORD);
+            uint64_t word = ~(uint64_t) 0;
+            for (size_t face = first_face; face < last_face; ++face)
+            {
+                size_t shift = 2 * (face - first_face);
+                word = (word & ~((uint64_t) 3 << shift)) | (face_code(figure.face(faces[face]), distance) << shift);
+            }
+            positions.set_word(word_id, word);
+        }
+    });
+}
+
+template<typename Index>
+PackedPositions classify_faces(const BasicFigure<Index> &figure, const Index *faces, size_t face_count,
+                               const Cut &cut, size_t max_threads)
+{
+    PackedPositions positions(face_count);
+    const VertexStreams &vertices = figure.get_vertices();
+    if (2 * face_count < vertices.size())
+    {
+        fill_codes(figure, faces, max_threads, [&](size_t vertex_id) {
+            return cut.point_distance(vertices[vertex_id]);
+        }, positions);
+        return positions;
+    }
+
+    ArenaScope scope;
+    std::vector<float, ArenaAllocator<float, STREAM_ALIGNMENT>> projected(vertices.padded_size());
+    float *projected_data = projected.data();
+    project_vertices(vertices, &cut.normal, 1, &projected_data, max_threads);
+    fill_codes(figure, faces, max_threads, [&](size_t vertex_id) {
+        return projected[vertex_id] + cut.offset;
+    }, positions);
+    return positions;
+}
+
+template PackedPositions classify_faces(const Figure32 &figure, const uint32_t *faces, size_t face_count,
+                                        const Cut &cut, size_t max_threads);
+template PackedPositions classify_faces(const Figure &figure, const size_t *faces, size_t face_count,
+                                        const Cut &cut, size_t max_threads);
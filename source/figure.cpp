@@ -1,34 +1,116 @@
 #include "geom.h"
 #include "figure.h"
 #include "geom_utils.h"
+#include "arena.h"
 #include <vector>
 #include <map>
 #include <unordered_map>
+#include <limits>
 
-Figure::Figure(std::vector<Point> vertices,
-        std::vector<std::vector<size_t>> faces) : vertices(std::move(vertices)), faces(std::move(faces))
+template<typename Index>
+BasicFigure<Index>::BasicFigure(VertexStreams vertices,
+        const std::vector<std::vector<size_t>> &faces) : vertices(std::move(vertices))
 {
-    face2cluster = std::vector<int>(this->faces.size(), -1);
+    flatten_faces(faces);
+    face2cluster = std::vector<int>(face_count(), -1);
 }
 
-Figure::Figure(const std::vector<std::array<double, 3>> &points,
-        std::vector<std::vector<size_t>> faces) : faces(std::move(faces))
-{    
-    vertices.reserve(points.size());
-    for (const auto &point : points)
+template<typename Index>
+BasicFigure<Index>::BasicFigure(VertexStreams vertices,
+        std::vector<Index> indices,
+        std::vector<size_t> face_offsets) : vertices(std::move(vertices)),
+                                            indices(std::move(indices)),
+                                            face_offsets(std::move(face_offsets))
+{
+    drop_triangle_offsets();
+    face2cluster = std::vector<int>(face_count(), -1);
+}
+
+template<typename Index>
+BasicFigure<Index>::BasicFigure(VertexStreams vertices,
+        std::vector<Index> indices,
+        std::vector<size_t> face_offsets,
+        std::vector<std::vector<Index>> clusters,
+        std::vector<int> face2cluster) : vertices(std::move(vertices)),
+                                         indices(std::move(indices)),
+                                         face_offsets(std::move(face_offsets)),
+                                         clusters(std::move(clusters)),
+                                         face2cluster(std::move(face2cluster))
+{
+    drop_triangle_offsets();
+}
+
+template<typename Index>
+template<typename OtherIndex>
+BasicFigure<Index>::BasicFigure(const BasicFigure<OtherIndex> &figure)
+        : vertices(figure.get_vertices()),
+          indices(figure.get_indices().begin(), figure.get_indices().end()),
+          face_offsets(figure.get_face_offsets()),
+          face2cluster(figure.get_face2cluster())
+{
+    clusters.reserve(figure.get_clusters().size());
+    for (const std::vector<OtherIndex> &cluster : figure.get_clusters())
+    {
+        clusters.emplace_back(cluster.begin(), cluster.end());
+    }
+}
+
+template<typename Index>
+BasicFigure<Index>::BasicFigure(const std::vector<std::array<double, 3>> &points,
+        const std::vector<std::vector<size_t>> &faces)
+        : vertices(points.size())
+{
+    for (size_t vertex_id = 0; vertex_id < points.size(); ++vertex_id)
     {
-        vertices.push_back({(float) point[0], (float) point[1], (float) point[2]});
+        vertices.x()[vertex_id] = (float) points[vertex_id][0];
+        vertices.y()[vertex_id] = (float) points[vertex_id][1];
+        vertices.z()[vertex_id] = (float) points[vertex_id][2];
     }
-    face2cluster = std::vector<int>(this->faces.size(), -1);
+    flatten_faces(faces);
+    face2cluster = std::vector<int>(face_count(), -1);
 }
 
-void Figure::set_clusters(const std::vector<std::vector<size_t>> &clusters)
+template<typename Index>
+bool BasicFigure<Index>::can_index(size_t vertex_count, size_t face_count)
+{
+    return vertex_count <= std::numeric_limits<Index>::max() && face_count <= std::numeric_limits<Index>::max();
+}
+
+template<typename Index>
+void BasicFigure<Index>::flatten_faces(const std::vector<std::vector<size_t>> &faces)
+{
+    face_offsets.reserve(faces.size() + 1);
+    face_offsets.push_back(0);
+    for (const std::vector<size_t> &face : faces)
+    {
+        indices.insert(indices.end(), face.begin(), face.end());
+        face_offsets.push_back(indices.size());
+    }
+    drop_triangle_offsets();
+}
+
+template<typename Index>
+void BasicFigure<Index>::drop_triangle_offsets()
+{
+    for (size_t face_id = 0; face_id < face_offsets.size(); ++face_id)
+    {
+        if (face_offsets[face_id] != 3 * face_id)
+        {
+            return;
+        }
+    }
+    face_offsets.clear();
+    face_offsets.shrink_to_fit();
+}
+
+template<typename Index>
+void BasicFigure<Index>::set_clusters(const std::vector<std::vector<Index>> &clusters)
 {
     this->clusters = clusters;
     std::fill(face2cluster.begin(), face2cluster.end(), -1);
     for (size_t cluster_id = 0; cluster_id < clusters.size(); ++cluster_id)
     {
-        const std::vector<size_t> &cluster = clusters[cluster_id];
+        const std::vector<Index> &cluster = clusters[cluster_id];
         for (size_t face_id : cluster)
         {
             face2cluster[face_id] = cluster_id;
@@ -36,112 +118,144 @@ void Figure::set_clusters(const std::vector<std::vector<size_t>> &clusters)
     }
 }
 
-std::vector<Point> Figure::turned_points(float x_angle, float y_angle, float z_angle) const
+template<typename Index>
+VertexStreams BasicFigure<Index>::turned_points(float x_angle, float y_angle, float z_angle) const
 {
     return turned_points(get_rotation_matrix(x_angle, y_angle, z_angle));
 }
 
-std::vector<Point> Figure::turned_points(const Matrix &rotation_matrix) const
+template<typename Index>
+VertexStreams BasicFigure<Index>::turned_points(const Mat3 &rotation_matrix) const
 {
-    std::vector<Point> new_vertices;
-    new_vertices.reserve(vertices.size());
-    for (const Point &point : vertices)
-    {
-        new_vertices.push_back(point.turned(rotation_matrix));
-    }
-
-    return new_vertices;
+    return turn_vertices(vertices, rotation_matrix);
 }
 
-Figure Figure::turned(float x_angle, float y_angle, float z_angle) const
+template<typename Index>
+BasicFigure<Index> BasicFigure<Index>::turned(float x_angle, float y_angle, float z_angle) const
 {
-    return Figure(turned_points(x_angle, y_angle, z_angle), faces);
+    return BasicFigure(turned_points(x_angle, y_angle, z_angle), indices, face_offsets);
 }
 
-Figure Figure::turned(const Matrix &rotation_matrix) const
+template<typename Index>
+BasicFigure<Index> BasicFigure<Index>::turned(const Mat3 &rotation_matrix) const
 {
-    return Figure(turned_points(rotation_matrix), faces);
+    return BasicFigure(turned_points(rotation_matrix), indices, face_offsets);
 }
 
-const std::vector<Point> &Figure::get_vertices() const
+template<typename Index>
+const VertexStreams &BasicFigure<Index>::get_vertices() const
 {
     return vertices;
 }
 
-const std::vector<std::vector<size_t>> &Figure::get_faces() const
+template<typename Index>
+bool BasicFigure<Index>::is_triangulated() const
+{
+    return face_offsets.empty();
+}
+
+template<typename Index>
+const std::vector<Index> &BasicFigure<Index>::get_indices() const
+{
+    return indices;
+}
+
+template<typename Index>
+const std::vector<size_t> &BasicFigure<Index>::get_face_offsets() const
 {
-    return faces;
+    return face_offsets;
 }
 
-const std::vector<std::vector<size_t>> &Figure::get_clusters() const
+template<typename Index>
+const std::vector<std::vector<Index>> &BasicFigure<Index>::get_clusters() const
 {
     return clusters;
 }
 
-const std::vector<int> &Figure::get_face2cluster() const
+template<typename Index>
+const std::vector<int> &BasicFigure<Index>::get_face2cluster() const
 {
     return face2cluster;
 }
 
 // Used in copy-constructor
+template<typename Index>
 template<typename T>
-void Figure::copy_vertices(const Figure &figure,
-                           const std::vector<size_t> &faces,
-                           T &new_index,
-                           const std::function<bool(size_t)> &is_presented)
+void BasicFigure<Index>::copy_vertices(const BasicFigure &figure,
+                                       const std::vector<Index> &faces,
+                                       T &new_index,
+                                       const std::function<bool(size_t)> &is_presented)
 {
-    vertices.reserve(figure.vertices.size());
-    size_t next_index = 0;
+    ScratchVector<Index> old_index;
     for (size_t face_id : faces)
     {
-        const std::vector<size_t> &face = figure.faces[face_id];
-        for (size_t vertex_id : face)
+        for (size_t vertex_id : figure.face(face_id))
         {
             if (!is_presented(vertex_id))
             {
-                vertices.push_back(figure.vertices[vertex_id]);
-                new_index[vertex_id] = next_index++;
+                new_index[vertex_id] = old_index.size();
+                old_index.push_back(vertex_id);
             }
         }
     }
-    vertices.shrink_to_fit();
+    vertices = VertexStreams(old_index.size());
+    const float *old_streams[3] = {figure.vertices.x(), figure.vertices.y(), figure.vertices.z()};
+    float *new_streams[3] = {vertices.x(), vertices.y(), vertices.z()};
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (size_t vertex_id = 0; vertex_id < old_index.size(); ++vertex_id)
+        {
+            new_streams[axis][vertex_id] = old_streams[axis][old_index[vertex_id]];
+        }
+    }
 
-    this->faces.reserve(faces.size());
+    if (!figure.is_triangulated())
+    {
+        face_offsets.reserve(faces.size() + 1);
+        face_offsets.push_back(0);
+    }
     for (size_t face_id : faces)
     {
-        const std::vector<size_t> &face = figure.faces[face_id];
-        std::vector<size_t> new_face;
-        new_face.reserve(face.size());
-        for (size_t vertex : face)
+        for (size_t vertex : figure.face(face_id))
         {
-            new_face.push_back(new_index[vertex]);
+            indices.push_back(new_index[vertex]);
+        }
+        if (!figure.is_triangulated())
+        {
+            face_offsets.push_back(indices.size());
         }
-        this->faces.push_back(new_face);
     }
+    drop_triangle_offsets();
 }
 
-Figure::Figure(const Figure &figure, const std::vector<size_t> &faces)
+template<typename Index>
+BasicFigure<Index>::BasicFigure(const BasicFigure &figure, const std::vector<Index> &faces)
 {
-    if (faces.size() * 4 >= figure.faces.size())
+    // Maps from old to new ids are scratch data, members of the figure are allocated as usual
+    ArenaScope scope;
+    indices.reserve(figure.is_triangulated() ? 3 * faces.size() : 0);
+    if (faces.size() * 4 >= figure.face_count())
     {
         // Linear copy
-        std::vector<size_t> new_index(figure.vertices.size(), SIZE_MAX);
-        copy_vertices(figure, faces, new_index, [&](int idx) {
-            return new_index[idx] != SIZE_MAX;
+        static const Index ABSENT = std::numeric_limits<Index>::max();
+        ScratchVector<Index> new_index(figure.vertices.size(), ABSENT);
+        copy_vertices(figure, faces, new_index, [&](size_t idx) {
+            return new_index[idx] != ABSENT;
         });
     }
     else
     {
         // Copy using map
-        std::map<size_t, size_t> new_index;
-        copy_vertices(figure, faces, new_index, [&](int idx) {
+        std::map<Index, Index, std::less<Index>, ArenaAllocator<std::pair<const Index, Index>>> new_index;
+        copy_vertices(figure, faces, new_index, [&](size_t idx) {
             return new_index.count(idx) != 0;
         });
     }
 
-    face2cluster = std::vector<int>(this->faces.size(), -1);
+    face2cluster = std::vector<int>(face_count(), -1);
 
-    std::unordered_map<size_t, int> new_cluster_id;
+    std::unordered_map<size_t, int, std::hash<size_t>, std::equal_to<size_t>,
+            ArenaAllocator<std::pair<const size_t, int>>> new_cluster_id;
     int cluster = 0;
 
     for (size_t new_face_id = 0; new_face_id < faces.size(); ++new_face_id)
@@ -161,3 +275,7 @@ Figure::Figure(const Figure &figure, const std::vector<size_t> &faces)
         }
     }
 }
+
+template class BasicFigure<uint32_t>;
+template class BasicFigure<size_t>;
+template BasicFigure<size_t>::BasicFigure(const BasicFigure<uint32_t> &figure);
@@ -0,0 +1,351 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "figure_cache.h"
+#include "mapped_file.h"
+#include "output_file.h"
+#include "parallel.h"
+
+static const char CACHE_MAGIC[8] = {'F', 'I', 'G', 'C', 'A', 'C', 'H', 'E'};
+static const uint32_t CACHE_VERSION = 3;
+static const size_t HASH_CHUNK = 1 << 26;
+static const size_t MIN_RANGE = 1 << 16;
+
+static_assert(sizeof(int) == sizeof(int32_t), "Cache sections are copied to and from figure storage as is");
+
+static inline uint64_t mix(uint64_t hash, uint64_t value)
+{
+    hash ^= value * 0x9E3779B97F4A7C15ull;
+    hash = (hash << 31) | (hash >> 33);
+    return hash * 0xBF58476D1CE4E5B9ull;
+}
+
+static uint64_t hash_bytes(const char *data, size_t size)
+{
+    uint64_t hash = size;
+    size_t words = size / sizeof(uint64_t);
+    for (size_t word_id = 0; word_id < words; ++word_id)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + word_id * sizeof(uint64_t), sizeof(uint64_t));
+        hash = mix(hash, word);
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, data + words * sizeof(uint64_t), size % sizeof(uint64_t));
+    return mix(hash, tail);
+}
+
+/** Returns hash of contents of file `filename`. Throws std::runtime_error if file cannot be read */
+static uint64_t hash_file(const std::string &filename)
+{
+    MappedFile file(filename, MAPPED_SEQUENTIAL);
+    // Chunks have fixed size, so hash does not depend on number of threads
+    size_t chunks = (file.size() + HASH_CHUNK - 1) / HASH_CHUNK;
+    std::vector<uint64_t> chunk_hashes(chunks);
+    parallel_for(chunks, 1, [&](size_t first, size_t last) {
+        for (size_t chunk = first; chunk < last; ++chunk)
+        {
+            size_t offset = chunk * HASH_CHUNK;
+            chunk_hashes[chunk] = hash_bytes(file.begin() + offset, std::min(HASH_CHUNK, file.size() - offset));
+        }
+    });
+    uint64_t hash = file.size();
+    for (uint64_t chunk_hash : chunk_hashes)
+    {
+        hash = mix(hash, chunk_hash);
+    }
+    return hash;
+}
+
+/** Reads size and modification time of `filename`, returns false if it cannot be read */
+static bool stat_file(const std::string &filename, uint64_t &size, uint64_t &mtime)
+{
+    struct stat status;
+    if (stat(filename.c_str(), &status) != 0)
+    {
+        return false;
+    }
+    size = status.st_size;
+    mtime = (uint64_t) status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+    return true;
+}
+
+static size_t padded(size_t size)
+{
+    return (size + 7) / 8 * 8;
+}
+
+/** Sizes of file sections in order of layout, including padding */
+static std::vector<size_t> section_sizes(const FigureCacheHeader &header)
+{
+    size_t index = header.index_size;
+    return {padded(sizeof(FigureCacheHeader)),
+            padded(header.key_length),
+            3 * padded(sizeof(float) * header.vertex_count),
+            padded(index * (header.face_count + 1)),
+            padded(index * header.index_count),
+            padded(index * (header.cluster_count + 1)),
+            padded(index * header.cluster_face_count),
+            padded(sizeof(int32_t) * header.face_count)};
+}
+
+bool cache_matches(const std::string &cache_filename, const std::string &source_filename, const std::string &key)
+{
+    std::ifstream in(cache_filename, std::ios::binary);
+    FigureCacheHeader header;
+    uint64_t source_size;
+    uint64_t source_mtime;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header.version != CACHE_VERSION || !stat_file(source_filename, source_size, source_mtime) ||
+        header.source_size != source_size || header.source_mtime != source_mtime ||
+        header.key_length != key.size() || (header.index_size != 4 && header.index_size != 8))
+    {
+        return false;
+    }
+    std::string stored_key(key.size(), '\0');
+    in.seekg(padded(sizeof(header)));
+    if (!in.read(&stored_key[0], stored_key.size()) || stored_key != key)
+    {
+        return false;
+    }
+
+    // Cache that was not written completely must not be used
+    size_t total_size = 0;
+    for (size_t size : section_sizes(header))
+    {
+        total_size += size;
+    }
+    in.seekg(0, std::ios::end);
+    if ((size_t) in.tellg() != total_size)
+    {
+        return false;
+    }
+    // Stamp of the source can be kept by a copy with other contents, only hash of the whole file is reliable
+    return header.source_hash == hash_file(source_filename);
+}
+
+/** Reads `count` values stored as `Stored`, section is copied as is if types have the same size */
+template<typename Stored, typename Value>
+static void read_values(const char *data, size_t count, std::vector<Value> &values)
+{
+    values.resize(count);
+    if (sizeof(Stored) == sizeof(Value))
+    {
+        std::memcpy(values.data(), data, sizeof(Value) * count);
+        return;
+    }
+    parallel_for(count, MIN_RANGE, [&](size_t first, size_t last) {
+        for (size_t value_id = first; value_id < last; ++value_id)
+        {
+            Stored value;
+            std::memcpy(&value, data + value_id * sizeof(Stored), sizeof(Stored));
+            values[value_id] = value;
+        }
+    });
+}
+
+template<typename Stored, typename Index>
+static void read_lists(const char *offsets, const char *values, size_t count, std::vector<std::vector<Index>> &lists)
+{
+    lists.resize(count);
+    parallel_for(count, MIN_RANGE, [&](size_t first, size_t last) {
+        for (size_t list_id = first; list_id < last; ++list_id)
+        {
+            Stored range[2];
+            std::memcpy(range, offsets + list_id * sizeof(Stored), sizeof(range));
+            std::vector<Index> &list = lists[list_id];
+            list.resize(range[1] - range[0]);
+            for (size_t i = 0; i < list.size(); ++i)
+            {
+                Stored value;
+                std::memcpy(&value, values + (range[0] + i) * sizeof(Stored), sizeof(Stored));
+                list[i] = value;
+            }
+        }
+    });
+}
+
+template<typename Index>
+BasicFigure<Index> read_figure_cache(const std::string &cache_filename)
+{
+    MappedFile file(cache_filename, MAPPED_SEQUENTIAL);
+    FigureCacheHeader header;
+    std::memcpy(&header, file.begin(), sizeof(header));
+    std::vector<size_t> sizes = section_sizes(header);
+    std::vector<const char *> sections(sizes.size());
+    sections[0] = file.begin();
+    for (size_t section = 1; section < sizes.size(); ++section)
+    {
+        sections[section] = sections[section - 1] + sizes[section - 1];
+    }
+
+    VertexStreams vertices(header.vertex_count);
+    size_t stream_size = padded(sizeof(float) * vertices.size());
+    std::memcpy(vertices.x(), sections[2], sizeof(float) * vertices.size());
+    std::memcpy(vertices.y(), sections[2] + stream_size, sizeof(float) * vertices.size());
+    std::memcpy(vertices.z(), sections[2] + 2 * stream_size, sizeof(float) * vertices.size());
+    std::vector<int> face2cluster(header.face_count);
+    std::memcpy(face2cluster.data(), sections[7], sizeof(int32_t) * face2cluster.size());
+
+    std::vector<size_t> face_offsets;
+    std::vector<Index> indices;
+    std::vector<std::vector<Index>> clusters;
+    if (header.index_size == 4)
+    {
+        read_values<uint32_t>(sections[3], header.face_count + 1, face_offsets);
+        read_values<uint32_t>(sections[4], header.index_count, indices);
+        read_lists<uint32_t>(sections[5], sections[6], header.cluster_count, clusters);
+    }
+    else
+    {
+        read_values<uint64_t>(sections[3], header.face_count + 1, face_offsets);
+        read_values<uint64_t>(sections[4], header.index_count, indices);
+        read_lists<uint64_t>(sections[5], sections[6], header.cluster_count, clusters);
+    }
+    return BasicFigure<Index>(std::move(vertices), std::move(indices), std::move(face_offsets), std::move(clusters),
+                  std::move(face2cluster));
+}
+
+static void write_padding(BufferedWriter &out, size_t size)
+{
+    static const char ZEROS[8] = {};
+    out.write(ZEROS, padded(size) - size);
+}
+
+template<typename Stored, typename Index>
+static void write_lists(BufferedWriter &out, const std::vector<std::vector<Index>> &lists)
+{
+    Stored offset = 0;
+    out.put<Stored>(offset);
+    for (const std::vector<Index> &list : lists)
+    {
+        offset += list.size();
+        out.put<Stored>(offset);
+    }
+    write_padding(out, sizeof(Stored) * (lists.size() + 1));
+    for (const std::vector<Index> &list : lists)
+    {
+        for (size_t value : list)
+        {
+            out.put<Stored>(value);
+        }
+    }
+    write_padding(out, sizeof(Stored) * offset);
+}
+
+/** Writes faces in the same layout as clusters, offsets of triangulated figure are restored */
+template<typename Stored, typename Index>
+static void write_faces(BufferedWriter &out, const BasicFigure<Index> &figure)
+{
+    for (size_t face_id = 0; face_id <= figure.face_count(); ++face_id)
+    {
+        out.put<Stored>(figure.is_triangulated() ? 3 * face_id : figure.get_face_offsets()[face_id]);
+    }
+    write_padding(out, sizeof(Stored) * (figure.face_count() + 1));
+    if (sizeof(Stored) == sizeof(Index))
+    {
+        out.write(figure.get_indices().data(), sizeof(Index) * figure.get_indices().size());
+    }
+    else
+    {
+        for (size_t vertex_id : figure.get_indices())
+        {
+            out.put<Stored>(vertex_id);
+        }
+    }
+    write_padding(out, sizeof(Stored) * figure.get_indices().size());
+}
+
+/**
+ * Creates empty file with unique name next to `cache_filename`, so that concurrent runs never write into the same file
+ * Returns its name. Throws std::runtime_error if it fails
+ */
+static std::string create_temporary_file(const std::string &cache_filename)
+{
+    std::string temporary_filename = cache_filename + ".XXXXXX";
+    int fd = mkstemp(&temporary_filename[0]);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Could not create temporary file for " + cache_filename);
+    }
+    // mkstemp creates file readable only by its owner, cache gets the same permissions as other outputs
+    fchmod(fd, 0644);
+    close(fd);
+    return temporary_filename;
+}
+
+template<typename Index>
+void write_figure_cache(const std::string &cache_filename, const std::string &source_filename, const std::string &key,
+                        const BasicFigure<Index> &figure)
+{
+    FigureCacheHeader header;
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    if (!stat_file(source_filename, header.source_size, header.source_mtime))
+    {
+        throw std::runtime_error("Could not read status of " + source_filename);
+    }
+    header.source_hash = hash_file(source_filename);
+    header.key_length = key.size();
+    header.vertex_count = figure.get_vertices().size();
+    header.face_count = figure.face_count();
+    header.index_count = figure.get_indices().size();
+    header.cluster_count = figure.get_clusters().size();
+    header.cluster_face_count = 0;
+    for (const std::vector<Index> &cluster : figure.get_clusters())
+    {
+        header.cluster_face_count += cluster.size();
+    }
+    header.index_size = std::max({header.vertex_count, header.face_count, header.index_count}) <= UINT32_MAX ? 4 : 8;
+
+    // Cache is written under temporary name, so that interrupted write never looks like a valid cache
+    std::string temporary_filename = create_temporary_file(cache_filename);
+    try
+    {
+        OutputFile file(temporary_filename);
+        BufferedWriter out(file, 0);
+        out.write(&header, sizeof(header));
+        write_padding(out, sizeof(header));
+        out.write(key.data(), key.size());
+        write_padding(out, key.size());
+        for (const float *stream : {figure.get_vertices().x(), figure.get_vertices().y(), figure.get_vertices().z()})
+        {
+            out.write(stream, sizeof(float) * header.vertex_count);
+            write_padding(out, sizeof(float) * header.vertex_count);
+        }
+        if (header.index_size == 4)
+        {
+            write_faces<uint32_t>(out, figure);
+            write_lists<uint32_t>(out, figure.get_clusters());
+        }
+        else
+        {
+            write_faces<uint64_t>(out, figure);
+            write_lists<uint64_t>(out, figure.get_clusters());
+        }
+        out.write(figure.get_face2cluster().data(), sizeof(int32_t) * header.face_count);
+        write_padding(out, sizeof(int32_t) * header.face_count);
+        out.flush();
+        if (std::rename(temporary_filename.c_str(), cache_filename.c_str()) != 0)
+        {
+            throw std::runtime_error("Could not move cache to " + cache_filename);
+        }
+    }
+    catch (...)
+    {
+        std::remove(temporary_filename.c_str());
+        throw;
+    }
+}
+
+template Figure32 read_figure_cache(const std::string &cache_filename);
+template Figure read_figure_cache(const std::string &cache_filename);
+template void write_figure_cache(const std::string &cache_filename, const std::string &source_filename,
+                                 const std::string &key, const Figure32 &figure);
+template void write_figure_cache(const std::string &cache_filename, const std::string &source_filename,
+                                 const std::string &key, const Figure &figure);
@@ -1,61 +1,145 @@
+#include <algorithm>
 #include <cmath>
-#include <set>
 #include <random>
-#include <mutex>
 #include "geom_utils.h"
+#include "parallel.h"
+#include "turn_kernels.h"
 
-Position line_triangle_position(const Line &line, const std::vector<size_t> &face, const Figure &figure)
+Mat3 get_rotation_matrix(float x_angle, float y_angle, float z_angle)
 {
-    static const float INTERSECT_EPS = 1e-6;
-    std::set<int> signs;
-    for (size_t point_id : face)
-    {
-        float point_position = line.point_position(figure.get_vertices()[point_id]);
-        if (std::fabs(point_position) > INTERSECT_EPS)
-        {
-            signs.insert(point_position < 0 ? -1 : 1);
-        }
-        else 
+    Mat3 x_matrix = {{{1, 0,                 0},
+                      {0, std::cos(x_angle), -std::sin(x_angle)},
+                      {0, std::sin(x_angle), std::cos(x_angle)}}};
+
+    Mat3 y_matrix = {{{std::cos(y_angle),  0, std::sin(y_angle)},
+                      {0,                  1, 0},
+                      {-std::sin(y_angle), 0, std::cos(y_angle)}}};
+
+    Mat3 z_matrix = {{{std::cos(z_angle), -std::sin(z_angle), 0},
+                      {std::sin(z_angle), std::cos(z_angle),  0},
+                      {0,                 0,                  1}}};
+
+    return x_matrix * y_matrix * z_matrix;
+}
+
+void turn_coordinate(const VertexStreams &vertices, const Mat3 &rotation_matrix, int axis, float *turned)
+{
+    // Point is a row vector, so turned coordinate is dot product with column `axis` of the matrix
+    Vec3 column = {{rotation_matrix.matrix[0][axis], rotation_matrix.matrix[1][axis], rotation_matrix.matrix[2][axis]}};
+    project_streams(vertices.x(), vertices.y(), vertices.z(), vertices.padded_size(), column, turned);
+}
+
+void project_vertices(const VertexStreams &vertices, const Vec3 *directions, size_t direction_count,
+                      float *const *projected, size_t max_threads)
+{
+    static const size_t MIN_RANGE = (size_t) 1 << 16;
+    // Ranges are split at multiples of kernel width, so every range keeps alignment of the streams
+    size_t widths = vertices.padded_size() / VertexStreams::WIDTH;
+    size_t ranges = std::max<size_t>(1, std::min(max_threads, vertices.padded_size() / MIN_RANGE));
+    parallel_for(ranges, 1, [&](size_t first_range, size_t last_range) {
+        size_t first = widths * first_range / ranges * VertexStreams::WIDTH;
+        size_t last = widths * last_range / ranges * VertexStreams::WIDTH;
+        std::vector<float *> range_projected(direction_count);
+        for (size_t direction = 0; direction < direction_count; ++direction)
         {
-            return CROSS;
+            range_projected[direction] = projected[direction] + first;
         }
-    }
-    if (signs.size() != 1)
+        project_streams(vertices.x() + first, vertices.y() + first, vertices.z() + first, last - first,
+                        directions, direction_count, range_projected.data());
+    });
+}
+
+void turn_coordinate(const VertexStreams &vertices, const Mat3 *rotation_matrices, size_t matrix_count, int axis,
+                     float *const *turned, size_t max_threads)
+{
+    std::vector<Vec3> columns(matrix_count);
+    for (size_t matrix = 0; matrix < matrix_count; ++matrix)
     {
-        return CROSS;
+        const Mat3 &rotation_matrix = rotation_matrices[matrix];
+        columns[matrix] = {{rotation_matrix.matrix[0][axis], rotation_matrix.matrix[1][axis],
+                            rotation_matrix.matrix[2][axis]}};
     }
-    return *signs.begin() == 1 ? LEFT : RIGHT;
+    project_vertices(vertices, columns.data(), matrix_count, turned, max_threads);
 }
 
-Matrix get_rotation_matrix(float x_angle, float y_angle, float z_angle)
+VertexStreams turn_vertices(const VertexStreams &vertices, const Mat3 &rotation_matrix)
 {
-    Matrix x_matrix = Matrix({{1, 0,            0},
-                              {0, std::cos(x_angle), -std::sin(x_angle)},
-                              {0, std::sin(x_angle), std::cos(x_angle)}});
-
-    Matrix y_matrix = Matrix({{std::cos(y_angle),  0, std::sin(y_angle)},
-                              {0,             1, 0},
-                              {-std::sin(y_angle), 0, std::cos(y_angle)}});
+    VertexStreams turned(vertices.size());
+    turn_streams(vertices.x(), vertices.y(), vertices.z(), vertices.padded_size(), rotation_matrix,
+                 turned.x(), turned.y(), turned.z());
+    return turned;
+}
 
-    Matrix z_matrix = Matrix({{std::cos(z_angle), -std::sin(z_angle), 0},
-                              {std::sin(z_angle), std::cos(z_angle),  0},
-                              {0,            0,             1}});
+float stream_extent(const float *values, size_t count)
+{
+    const float INF = 1e9;
+    float min = INF;
+    float max = -INF;
+    for (size_t value_id = 0; value_id < count; ++value_id)
+    {
+        min = std::min(min, values[value_id]);
+        max = std::max(max, values[value_id]);
+    }
+    return max - min;
+}
 
-    return x_matrix * y_matrix * z_matrix;
+float generate_random_angle(std::mt19937_64 &generator) {
+    static const double PI = atan2(0, -1);
+    std::uniform_real_distribution<> urd(0, 2 * PI);
+    return urd(generator);
 }
 
-float generate_random_angle() {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::mutex mutex;
+/** Uniformly distributed random rotation, built from random unit quaternion */
+static Mat3 random_rotation(std::mt19937_64 &generator)
+{
     static const double PI = atan2(0, -1);
-    static std::uniform_real_distribution<> urd(0, 2 * PI);
+    std::uniform_real_distribution<double> urd(0, 1);
+    double u1 = urd(generator);
+    double u2 = urd(generator);
+    double u3 = urd(generator);
+    double x = std::sqrt(1 - u1) * std::sin(2 * PI * u2);
+    double y = std::sqrt(1 - u1) * std::cos(2 * PI * u2);
+    double z = std::sqrt(u1) * std::sin(2 * PI * u3);
+    double w = std::sqrt(u1) * std::cos(2 * PI * u3);
+    return {{{(float) (1 - 2 * (y * y + z * z)), (float) (2 * (x * y - z * w)), (float) (2 * (x * z + y * w))},
+             {(float) (2 * (x * y + z * w)), (float) (1 - 2 * (x * x + z * z)), (float) (2 * (y * z - x * w))},
+             {(float) (2 * (x * z - y * w)), (float) (2 * (y * z + x * w)), (float) (1 - 2 * (x * x + y * y))}}};
+}
 
-    mutex.lock();
-    float angle = urd(gen);
-    mutex.unlock();
+/** Rotation matrix whose column 0, that is turned x axis, is unit vector `direction` */
+static Mat3 rotation_with_x_axis(const Vec3 &direction)
+{
+    // Any unit vector orthogonal to the direction completes the basis
+    Vec3 helper = std::fabs(direction[0]) < 0.9f ? Vec3{{1, 0, 0}} : Vec3{{0, 1, 0}};
+    Vec3 second = {{helper[1] * direction[2] - helper[2] * direction[1],
+                    helper[2] * direction[0] - helper[0] * direction[2],
+                    helper[0] * direction[1] - helper[1] * direction[0]}};
+    float length = std::sqrt(second[0] * second[0] + second[1] * second[1] + second[2] * second[2]);
+    second = {{second[0] / length, second[1] / length, second[2] / length}};
+    Vec3 third = {{direction[1] * second[2] - direction[2] * second[1],
+                   direction[2] * second[0] - direction[0] * second[2],
+                   direction[0] * second[1] - direction[1] * second[0]}};
+    return {{{direction[0], second[0], third[0]},
+             {direction[1], second[1], third[1]},
+             {direction[2], second[2], third[2]}}};
+}
 
-    return angle;
+std::vector<Mat3> generate_cut_rotations(size_t count, std::mt19937_64 &generator)
+{
+    static const double PI = atan2(0, -1);
+    static const double GOLDEN_ANGLE = PI * (3 - std::sqrt(5.0));
+    Mat3 lattice_rotation = random_rotation(generator);
+    std::vector<Mat3> rotations;
+    rotations.reserve(count);
+    for (size_t point = 0; point < count; ++point)
+    {
+        double z = (point + 0.5) / count;
+        double radius = std::sqrt(1 - z * z);
+        double angle = point * GOLDEN_ANGLE;
+        Vec3 lattice_point = {{(float) (radius * std::cos(angle)), (float) (radius * std::sin(angle)), (float) z}};
+        rotations.push_back(rotation_with_x_axis(lattice_point * lattice_rotation));
+    }
+    return rotations;
 }
 
 void Vector3d::normalize()
@@ -84,11 +168,13 @@ Vector3d operator/(const Vector3d &a, float x)
     return {a.x / x, a.y / x, a.z / x};
 }
 
-Vector3d build_normal(size_t face_id, const Figure& figure)
+template<typename Index>
+Vector3d build_normal(size_t face_id, const BasicFigure<Index> &figure)
 {
-    const Point &p1 = figure.get_vertices()[figure.get_faces()[face_id][0]];
-    const Point &p2 = figure.get_vertices()[figure.get_faces()[face_id][1]];
-    const Point &p3 = figure.get_vertices()[figure.get_faces()[face_id][2]];
+    BasicFaceView<Index> face = figure.face(face_id);
+    Point p1 = figure.get_vertices()[face[0]];
+    Point p2 = figure.get_vertices()[face[1]];
+    Point p3 = figure.get_vertices()[face[2]];
     float x = (p2.y - p1.y) * (p3.z - p1.z) - (p2.z - p1.z) * (p3.y - p1.y);
     float y = (p2.z - p1.z) * (p3.x - p1.x) - (p2.x - p1.x) * (p3.z - p1.z);
     float z = (p2.x - p1.x) * (p3.y - p1.y) - (p2.y - p1.y) * (p3.x - p1.x);
@@ -97,6 +183,9 @@ Vector3d build_normal(size_t face_id, const Figure& figure)
     return normal;
 }
 
+template Vector3d build_normal(size_t face_id, const Figure32 &figure);
+template Vector3d build_normal(size_t face_id, const Figure &figure);
+
 float distance(Vector3d a, Vector3d b)
 {
     a.normalize();
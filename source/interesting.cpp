@@ -5,13 +5,16 @@
 #include <set>
 #include <algorithm>
 #include <queue>
+#include <random>
 #include "geom_utils.h"
 
+/** Graph of faces of figure, where adjacent faces are connected. Vertices are face ids of type `Index` */
+template<typename Index>
 class Graph {
 public:
-    std::vector<std::vector<size_t>> edges;
+    std::vector<std::vector<Index>> edges;
     std::vector<bool> used;
-    std::vector<size_t> color;
+    std::vector<Index> color;
     int n = 0;
 
     void clear_used()
@@ -28,10 +31,11 @@ public:
     }
 
     void interesting_bfs(size_t vertex_id, size_t color, const std::vector<Vector3d> &normals,
-            std::vector<size_t> &this_color);
+            std::vector<Index> &this_color);
 };
 
-std::pair<size_t, size_t> &sort_pair(std::pair<size_t, size_t> &pair)
+template<typename Index>
+std::pair<Index, Index> &sort_pair(std::pair<Index, Index> &pair)
 {
     if (pair.first > pair.second)
     {
@@ -40,31 +44,32 @@ std::pair<size_t, size_t> &sort_pair(std::pair<size_t, size_t> &pair)
     return pair;
 }
 
-Graph figure2graph(const Figure &figure)
+template<typename Index>
+Graph<Index> figure2graph(const BasicFigure<Index> &figure)
 {
-    std::map<std::pair<size_t, size_t>, std::vector<size_t>> neighbours;
-    for (size_t face_id = 0; face_id < figure.get_faces().size(); ++face_id)
+    std::map<std::pair<Index, Index>, std::vector<Index>> neighbours;
+    for (size_t face_id = 0; face_id < figure.face_count(); ++face_id)
     {
-        const std::vector<size_t> &face = figure.get_faces()[face_id];
+        BasicFaceView<Index> face = figure.face(face_id);
         for (size_t first_vertex = 0; first_vertex < face.size(); ++first_vertex)
         {
             for (size_t second_vertex = first_vertex + 1; second_vertex < face.size(); ++second_vertex)
             {
-                std::pair<size_t, size_t> edge = {face[first_vertex], face[second_vertex]};
+                std::pair<Index, Index> edge = {(Index) face[first_vertex], (Index) face[second_vertex]};
                 neighbours[sort_pair(edge)].push_back(face_id);
             }
         }
     }
 
-    Graph graph = Graph();
-    graph.resize(figure.get_faces().size());
+    Graph<Index> graph = Graph<Index>();
+    graph.resize(figure.face_count());
 
     for (const auto &edge_neighbours : neighbours)
     {
-        const std::vector<size_t> &current_neighbours = edge_neighbours.second;
-        for (size_t face_a : current_neighbours)
+        const std::vector<Index> &current_neighbours = edge_neighbours.second;
+        for (Index face_a : current_neighbours)
         {
-            for (size_t face_b : current_neighbours)
+            for (Index face_b : current_neighbours)
             {
                 if (face_a != face_b)
                 {
@@ -76,7 +81,8 @@ Graph figure2graph(const Figure &figure)
     return graph;
 }
 
-float max_distance(const std::vector<size_t> &this_color, const std::vector<Vector3d> &normals, const Vector3d &norm)
+template<typename Index>
+float max_distance(const std::vector<Index> &this_color, const std::vector<Vector3d> &normals, const Vector3d &norm)
 {
     float max_dist = 0;
     for (size_t id : this_color)
@@ -91,11 +97,12 @@ float max_distance(const std::vector<size_t> &this_color, const std::vector<Vect
 /* Finds component for `vertex_id` vertex (face).
  * Binary relation "to be in one component" is not transitive
  */
-void Graph::interesting_bfs(size_t vertex_id, size_t current_color, const std::vector<Vector3d> &normals,
-        std::vector<size_t> &this_color)
+template<typename Index>
+void Graph<Index>::interesting_bfs(size_t vertex_id, size_t current_color, const std::vector<Vector3d> &normals,
+        std::vector<Index> &this_color)
 {
     static const float DIFF = 0.4;
-    std::queue<size_t> q;
+    std::queue<Index> q;
     q.push(vertex_id);
     used[vertex_id] = true;
     Vector3d mean = {0, 0, 0}; // mean normal vector in a component
@@ -117,37 +124,21 @@ void Graph::interesting_bfs(size_t vertex_id, size_t current_color, const std::v
     }
 }
 
-bool is_not_line_kind(const std::vector<size_t> &small_figure, const Figure &base_figure) {
-    Figure unturned = Figure(base_figure, small_figure);
+template<typename Index>
+bool is_not_line_kind(const std::vector<Index> &small_figure, const BasicFigure<Index> &base_figure,
+                      std::mt19937_64 &generator) {
+    BasicFigure<Index> unturned = BasicFigure<Index>(base_figure, small_figure);
     for (size_t i = 0; i < 20; ++i)
     {
-        float x_angle = generate_random_angle();
-        float y_angle = generate_random_angle();
-        float z_angle = generate_random_angle();
+        float x_angle = generate_random_angle(generator);
+        float y_angle = generate_random_angle(generator);
+        float z_angle = generate_random_angle(generator);
 
-        std::vector<Point> turned_points = unturned.turned_points(x_angle, y_angle, z_angle);
+        VertexStreams turned_points = unturned.turned_points(x_angle, y_angle, z_angle);
 
-        const float INF = 1e9;
-        float min_x = INF;
-        float max_x = -INF;
-        float min_y = INF;
-        float max_y = -INF;
-        float min_z = INF;
-        float max_z = -INF;
-
-        for (const Point &p : turned_points)
-        {
-            min_x = std::min(min_x, p.x);
-            max_x = std::max(max_x, p.x);
-            min_y = std::min(min_y, p.y);
-            max_y = std::max(max_y, p.y);
-            min_z = std::min(min_z, p.z);
-            max_z = std::max(max_z, p.z);
-        }
-
-        float len1 = max_x - min_x;
-        float len2 = max_y - min_y;
-        float len3 = max_z - min_z;
+        float len1 = stream_extent(turned_points.x(), turned_points.size());
+        float len2 = stream_extent(turned_points.y(), turned_points.size());
+        float len3 = stream_extent(turned_points.z(), turned_points.size());
         float max_len = std::max({len1, len2, len3});
 
         if (max_len > 3 * (len1 + len2 + len3 - max_len))
@@ -161,16 +152,17 @@ bool is_not_line_kind(const std::vector<size_t> &small_figure, const Figure &bas
 /*
  * Connects some clusters to build bigger cluster from them
  */
-std::vector<std::vector<size_t>> do_small_connection(std::vector<std::vector<size_t>> figures, const Figure &figure, 
-    const Parameters &params)
+template<typename Index>
+std::vector<std::vector<Index>> do_small_connection(std::vector<std::vector<Index>> figures,
+    const BasicFigure<Index> &figure, const Parameters &params, std::mt19937_64 &generator)
 {
-    std::map<size_t, std::set<size_t>> vertex2figures; // which figures from `figures` have this vertex
+    std::map<Index, std::set<size_t>> vertex2figures; // which figures from `figures` have this vertex
     for (size_t figure_id = 0; figure_id < figures.size(); ++figure_id)
     {
-        const std::vector<size_t> &face_ids = figures[figure_id];
+        const std::vector<Index> &face_ids = figures[figure_id];
         for (size_t face_id : face_ids)
         {
-            for (size_t vertex_id : figure.get_faces()[face_id])
+            for (size_t vertex_id : figure.face(face_id))
             {
                 vertex2figures[vertex_id].insert(figure_id);
            }
@@ -182,7 +174,7 @@ std::vector<std::vector<size_t>> do_small_connection(std::vector<std::vector<siz
     {
         ordered_figures.insert({figures[i].size(), i});
     } 
-    std::vector<std::vector<size_t>> ans;
+    std::vector<std::vector<Index>> ans;
 
     while (!ordered_figures.empty())
     {
@@ -197,7 +189,7 @@ std::vector<std::vector<size_t>> do_small_connection(std::vector<std::vector<siz
         // and such that combining it with current, we eill have not a very big cluster
         for (size_t face_id : figures[cur_figure_id])
         {
-            for (size_t vertex_id : figure.get_faces()[face_id])
+            for (size_t vertex_id : figure.face(face_id))
             {
                 for (size_t figure_id : vertex2figures[vertex_id])
                 {
@@ -218,7 +210,7 @@ std::vector<std::vector<size_t>> do_small_connection(std::vector<std::vector<siz
 
         if (best_result == 0)
         {
-            if (!params.optimize_clusters || is_not_line_kind(figures[cur_figure_id], figure)) {
+            if (!params.optimize_clusters || is_not_line_kind(figures[cur_figure_id], figure, generator)) {
                 ans.push_back(figures[cur_figure_id]);
             }
         }
@@ -226,7 +218,7 @@ std::vector<std::vector<size_t>> do_small_connection(std::vector<std::vector<siz
         {
             for (size_t face_id : figures[cur_figure_id])
             {
-                for (size_t vertex_id : figure.get_faces()[face_id])
+                for (size_t vertex_id : figure.face(face_id))
                 {
                     vertex2figures[vertex_id].erase(cur_figure_id);
                     vertex2figures[vertex_id].insert(best_id);
@@ -245,34 +237,38 @@ std::vector<std::vector<size_t>> do_small_connection(std::vector<std::vector<siz
     return ans;
 }
 
-std::vector<std::vector<size_t>> run_bfs(Graph &graph, const Figure &figure, const Parameters &params)
+template<typename Index>
+std::vector<std::vector<Index>> run_bfs(Graph<Index> &graph, const BasicFigure<Index> &figure,
+    const Parameters &params, uint64_t seed)
 {
+    // Clusters are tested one by one, so one generator gives the same angles to them on every run
+    std::mt19937_64 generator(seed);
     std::vector<Vector3d> normals;
     normals.reserve(figure.get_vertices().size());
-    for (size_t face_id = 0; face_id < figure.get_faces().size(); ++face_id)
+    for (size_t face_id = 0; face_id < figure.face_count(); ++face_id)
     {
         normals.push_back(build_normal(face_id, figure));
     }
     size_t color = 0;
-    std::vector<std::vector<size_t>> small_figures;
+    std::vector<std::vector<Index>> small_figures;
     for (size_t vertex_id = 0; vertex_id < graph.n; ++vertex_id)
     {
         if (!graph.used[vertex_id])
         {
-            std::vector<size_t> faces;
+            std::vector<Index> faces;
             graph.interesting_bfs(vertex_id, color++, normals, faces);
             if (faces.size() <= params.cluster_max_size)
             {
-                if (!params.optimize_clusters || faces.size() < 1000 || is_not_line_kind(faces, figure)) {
+                if (!params.optimize_clusters || faces.size() < 1000 || is_not_line_kind(faces, figure, generator)) {
                     small_figures.push_back(faces);
                 }
             }
         }
     }
-    std::vector<std::vector<size_t>> figures = do_small_connection(small_figures, figure, params);
-    std::vector<std::vector<size_t>> ans;
+    std::vector<std::vector<Index>> figures = do_small_connection(small_figures, figure, params, generator);
+    std::vector<std::vector<Index>> ans;
     ans.reserve(figures.size());
-    for (const std::vector<size_t> &small_figure : figures)
+    for (const std::vector<Index> &small_figure : figures)
     {
         if (small_figure.size() >= params.cluster_min_size)
         {
@@ -283,8 +279,15 @@ std::vector<std::vector<size_t>> run_bfs(Graph &graph, const Figure &figure, con
     return ans;
 }
 
-std::vector<std::vector<size_t>> divide_interesting(const Figure &figure, const Parameters &params)
+template<typename Index>
+std::vector<std::vector<Index>> divide_interesting(const BasicFigure<Index> &figure, const Parameters &params,
+                                                   uint64_t seed)
 {
-    Graph graph = figure2graph(figure);
-    return run_bfs(graph, figure, params);
+    Graph<Index> graph = figure2graph(figure);
+    return run_bfs(graph, figure, params, seed);
 }
+
+template std::vector<std::vector<uint32_t>> divide_interesting(const Figure32 &figure, const Parameters &params,
+                                                               uint64_t seed);
+template std::vector<std::vector<size_t>> divide_interesting(const Figure &figure, const Parameters &params,
+                                                             uint64_t seed);
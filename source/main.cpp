@@ -1,9 +1,11 @@
 #include "executor.h"
+#include "parallel.h"
 #include "parser.h"
 
 int main(int argc, char *argv[])
 {
     Parameters params = parse_parameters(argc, argv);
+    set_thread_count(params.threads);
     multi_thread_executor(params.filename, params.to_string(), params);
     return 0;
 }
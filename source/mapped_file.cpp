@@ -0,0 +1,61 @@
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mapped_file.h"
+
+MappedFile::MappedFile(const std::string &path, MappedAccess access)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Could not open file " + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Could not stat file " + path);
+    }
+    length = (size_t) file_stat.st_size;
+    if (length > 0)
+    {
+        void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("Could not map file " + path);
+        }
+        if (access == MAPPED_SEQUENTIAL)
+        {
+            madvise(mapping, length, MADV_SEQUENTIAL);
+        }
+        data = static_cast<const char *>(mapping);
+    }
+    // Mapping stays valid after descriptor is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data != nullptr)
+    {
+        munmap(const_cast<char *>(data), length);
+    }
+}
+
+const char *MappedFile::begin() const
+{
+    return data;
+}
+
+const char *MappedFile::end() const
+{
+    return data + length;
+}
+
+size_t MappedFile::size() const
+{
+    return length;
+}
@@ -0,0 +1,498 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "mesh_codec.h"
+#include "output_file.h"
+
+static const char CODEC_MAGIC[8] = {'M', 'E', 'S', 'H', 'P', 'A', 'C', 'K'};
+static const uint32_t CODEC_VERSION = 1;
+static const int POSITION_BITS = 20;
+static const int UV_BITS = 16;
+static const size_t CACHE_SIZE = 16;
+
+static_assert(sizeof(Point2d) == 2 * sizeof(float), "Decoded UVs are written into points as arrays of floats");
+
+enum CodecFlag {
+    CODEC_HAS_UVS = 1,
+    CODEC_TRIANGLES = 2
+};
+
+class CodecHeader {
+public:
+    char magic[8];
+    uint32_t version;
+    uint8_t position_bits;
+    uint8_t uv_bits;
+    uint8_t flags;
+    uint8_t reserved;
+    uint64_t vertex_count;
+    uint64_t face_count;
+    uint64_t uv_count;
+    /** Size of varint stream that follows the header */
+    uint64_t data_size;
+    double position_origin[3];
+    double position_step[3];
+    double uv_origin[2];
+    double uv_step[2];
+};
+
+bool is_compressed_mesh(const char *begin, const char *end)
+{
+    return (size_t) (end - begin) >= sizeof(CODEC_MAGIC) && std::memcmp(begin, CODEC_MAGIC, sizeof(CODEC_MAGIC)) == 0;
+}
+
+static void read_header(const char *begin, const char *end, CodecHeader &header)
+{
+    if ((size_t) (end - begin) < sizeof(header) || !is_compressed_mesh(begin, end))
+    {
+        throw std::runtime_error("Compressed mesh: missing header");
+    }
+    std::memcpy(&header, begin, sizeof(header));
+}
+
+void read_compressed_mesh_size(const char *begin, const char *end, size_t &vertex_count, size_t &face_count)
+{
+    CodecHeader header;
+    read_header(begin, end, header);
+    vertex_count = header.vertex_count;
+    face_count = header.face_count;
+}
+
+static float coordinate(const Point &point, int axis)
+{
+    return axis == 0 ? point.x : axis == 1 ? point.y : point.z;
+}
+
+static float coordinate(const Point2d &point, int axis)
+{
+    return axis == 0 ? point.x : point.y;
+}
+
+static void put_varint(std::string &data, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        data.push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    data.push_back((char) value);
+}
+
+static uint64_t get_varint(const char *&position, const char *end)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (position == end)
+        {
+            throw std::runtime_error("Compressed mesh: unexpected end of data");
+        }
+        uint8_t byte = (uint8_t) *position++;
+        value |= (uint64_t) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+    throw std::runtime_error("Compressed mesh: malformed varint");
+}
+
+static uint64_t zigzag(int64_t value)
+{
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+/**
+ * Orders triangles so that consecutive ones share vertices in a cache of `CACHE_SIZE` vertices
+ * (Tipsify, Sander et al. 2007). Returns ids of faces in new order
+ */
+template<typename Index>
+static std::vector<size_t> cache_order(const BasicFigure<Index> &figure)
+{
+    size_t vertex_count = figure.get_vertices().size();
+    std::vector<size_t> offsets(vertex_count + 1, 0);
+    for (size_t vertex_id : figure.get_indices())
+    {
+        ++offsets[vertex_id + 1];
+    }
+    for (size_t vertex_id = 0; vertex_id < vertex_count; ++vertex_id)
+    {
+        offsets[vertex_id + 1] += offsets[vertex_id];
+    }
+    std::vector<size_t> adjacency(offsets.back());
+    std::vector<size_t> filled(offsets.begin(), offsets.end() - 1);
+    for (size_t face_id = 0; face_id < figure.face_count(); ++face_id)
+    {
+        for (size_t vertex_id : figure.face(face_id))
+        {
+            adjacency[filled[vertex_id]++] = face_id;
+        }
+    }
+
+    std::vector<size_t> live(vertex_count);
+    for (size_t vertex_id = 0; vertex_id < vertex_count; ++vertex_id)
+    {
+        live[vertex_id] = offsets[vertex_id + 1] - offsets[vertex_id];
+    }
+    std::vector<size_t> cache_time(vertex_count, 0);
+    std::vector<char> emitted(figure.face_count(), 0);
+    std::vector<size_t> dead_end;
+    std::vector<size_t> candidates;
+    std::vector<size_t> order;
+    order.reserve(figure.face_count());
+    size_t time = CACHE_SIZE + 1;
+    size_t cursor = 0;
+    size_t fan = 0;
+    bool has_fan = vertex_count > 0;
+    while (has_fan)
+    {
+        // Emit all faces around fan vertex
+        candidates.clear();
+        for (size_t i = offsets[fan]; i < offsets[fan + 1]; ++i)
+        {
+            size_t face_id = adjacency[i];
+            if (emitted[face_id])
+            {
+                continue;
+            }
+            emitted[face_id] = 1;
+            order.push_back(face_id);
+            for (size_t vertex_id : figure.face(face_id))
+            {
+                dead_end.push_back(vertex_id);
+                candidates.push_back(vertex_id);
+                --live[vertex_id];
+                if (time - cache_time[vertex_id] > CACHE_SIZE)
+                {
+                    cache_time[vertex_id] = time++;
+                }
+            }
+        }
+
+        // Next fan is the oldest candidate that stays in cache while its remaining faces are emitted
+        has_fan = false;
+        size_t best_priority = 0;
+        for (size_t vertex_id : candidates)
+        {
+            if (live[vertex_id] == 0)
+            {
+                continue;
+            }
+            size_t age = time - cache_time[vertex_id];
+            size_t priority = age + 2 * live[vertex_id] <= CACHE_SIZE ? age : 0;
+            if (!has_fan || priority > best_priority)
+            {
+                has_fan = true;
+                best_priority = priority;
+                fan = vertex_id;
+            }
+        }
+        while (!has_fan && !dead_end.empty())
+        {
+            fan = dead_end.back();
+            dead_end.pop_back();
+            has_fan = live[fan] > 0;
+        }
+        while (!has_fan && cursor < vertex_count)
+        {
+            fan = cursor++;
+            has_fan = live[fan] > 0;
+        }
+    }
+    return order;
+}
+
+template<typename Index>
+static BasicFaceView<Index> list_at(const BasicFigure<Index> &figure, size_t face_id)
+{
+    return figure.face(face_id);
+}
+
+static const std::vector<size_t> &list_at(const std::vector<std::vector<size_t>> &lists, size_t list_id)
+{
+    return lists[list_id];
+}
+
+/**
+ * Returns ids of values in order of their first use by `lists` taken in `order`, unused values go last
+ * `new_index` is filled with positions of values in the result
+ */
+template<typename Lists>
+static std::vector<size_t> first_use_order(const Lists &lists,
+                                           const std::vector<size_t> &order, size_t count,
+                                           std::vector<size_t> &new_index)
+{
+    new_index.assign(count, SIZE_MAX);
+    std::vector<size_t> old_index;
+    old_index.reserve(count);
+    for (size_t list_id : order)
+    {
+        for (size_t value : list_at(lists, list_id))
+        {
+            if (value >= count)
+            {
+                throw std::runtime_error("Compressed mesh: index " + std::to_string(value) + " is out of range");
+            }
+            if (new_index[value] == SIZE_MAX)
+            {
+                new_index[value] = old_index.size();
+                old_index.push_back(value);
+            }
+        }
+    }
+    for (size_t value = 0; value < count; ++value)
+    {
+        if (new_index[value] == SIZE_MAX)
+        {
+            new_index[value] = old_index.size();
+            old_index.push_back(value);
+        }
+    }
+    return old_index;
+}
+
+/** Every index is stored as distance to the next unused index, so new and recently used indices take one byte */
+template<typename Lists>
+static void encode_indices(std::string &data, const Lists &lists,
+                           const std::vector<size_t> &order, const std::vector<size_t> &new_index)
+{
+    size_t next_unused = 0;
+    for (size_t list_id : order)
+    {
+        for (size_t value : list_at(lists, list_id))
+        {
+            size_t index = new_index[value];
+            put_varint(data, next_unused - index);
+            if (index == next_unused)
+            {
+                ++next_unused;
+            }
+        }
+    }
+}
+
+template<typename Index>
+static void decode_indices(const char *&position, const char *end, size_t count, std::vector<Index> &values)
+{
+    size_t next_unused = 0;
+    for (Index &value : values)
+    {
+        uint64_t distance = get_varint(position, end);
+        if (distance > next_unused || (distance == 0 && next_unused == count))
+        {
+            throw std::runtime_error("Compressed mesh: index is out of range");
+        }
+        value = next_unused - distance;
+        if (distance == 0)
+        {
+            ++next_unused;
+        }
+    }
+}
+
+/**
+ * Quantizes coordinates of `points` taken in `order` inside their bounding box and stores them as deltas
+ * `points` is array of Point2d or VertexStreams
+ */
+template<typename Points>
+static void encode_coordinates(std::string &data, const Points &points, const std::vector<size_t> &order,
+                               int dimensions, int bits, double *origin, double *step)
+{
+    for (int axis = 0; axis < dimensions; ++axis)
+    {
+        float min = 0;
+        float max = 0;
+        for (size_t point_id = 0; point_id < points.size(); ++point_id)
+        {
+            float value = coordinate(points[point_id], axis);
+            min = point_id == 0 ? value : std::min(min, value);
+            max = point_id == 0 ? value : std::max(max, value);
+        }
+        origin[axis] = min;
+        step[axis] = ((double) max - min) / ((1u << bits) - 1);
+    }
+    int64_t previous[3] = {0, 0, 0};
+    for (size_t point_id : order)
+    {
+        for (int axis = 0; axis < dimensions; ++axis)
+        {
+            double offset = coordinate(points[point_id], axis) - origin[axis];
+            int64_t quantized = step[axis] > 0 ? (int64_t) std::llround(offset / step[axis]) : 0;
+            put_varint(data, zigzag(quantized - previous[axis]));
+            previous[axis] = quantized;
+        }
+    }
+}
+
+/** Coordinate `axis` of point `i` is written into `axes[axis][i * spacing]` */
+static void decode_coordinates(const char *&position, const char *end, int dimensions,
+                               const double *origin, const double *step, float *const *axes, size_t spacing,
+                               size_t count)
+{
+    int64_t quantized[3] = {0, 0, 0};
+    for (size_t point_id = 0; point_id < count; ++point_id)
+    {
+        for (int axis = 0; axis < dimensions; ++axis)
+        {
+            quantized[axis] += unzigzag(get_varint(position, end));
+            axes[axis][point_id * spacing] = (float) (origin[axis] + quantized[axis] * step[axis]);
+        }
+    }
+}
+
+template<typename Index>
+void write_compressed_mesh(const std::string &filename, const BasicFigure<Index> &figure,
+                           const std::vector<Point2d> *uvs, const std::vector<std::vector<size_t>> *uvfaces)
+{
+    const VertexStreams &vertices = figure.get_vertices();
+    size_t face_count = figure.face_count();
+    bool has_uvs = uvs != nullptr && uvfaces != nullptr;
+    bool triangles = figure.is_triangulated();
+
+    CodecHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CODEC_MAGIC, sizeof(CODEC_MAGIC));
+    header.version = CODEC_VERSION;
+    header.position_bits = POSITION_BITS;
+    header.uv_bits = UV_BITS;
+    header.flags = (has_uvs ? CODEC_HAS_UVS : 0) | (triangles ? CODEC_TRIANGLES : 0);
+    header.vertex_count = vertices.size();
+    header.face_count = face_count;
+    header.uv_count = has_uvs ? uvs->size() : 0;
+
+    std::vector<size_t> face_order;
+    if (triangles)
+    {
+        face_order = cache_order(figure);
+    }
+    else
+    {
+        for (size_t face_id = 0; face_id < face_count; ++face_id)
+        {
+            face_order.push_back(face_id);
+        }
+    }
+
+    std::string data;
+    if (!triangles)
+    {
+        for (size_t face_id : face_order)
+        {
+            put_varint(data, figure.face(face_id).size());
+        }
+    }
+    std::vector<size_t> new_vertex_index;
+    std::vector<size_t> vertex_order = first_use_order(figure, face_order, vertices.size(), new_vertex_index);
+    encode_indices(data, figure, face_order, new_vertex_index);
+    std::vector<size_t> uv_order;
+    if (has_uvs)
+    {
+        for (size_t face_id = 0; face_id < face_count; ++face_id)
+        {
+            if ((*uvfaces)[face_id].size() != figure.face(face_id).size())
+            {
+                throw std::runtime_error("Compressed mesh: uv face " + std::to_string(face_id) +
+                                         " differs in size from its face");
+            }
+        }
+        std::vector<size_t> new_uv_index;
+        uv_order = first_use_order(*uvfaces, face_order, uvs->size(), new_uv_index);
+        encode_indices(data, *uvfaces, face_order, new_uv_index);
+    }
+    encode_coordinates(data, vertices, vertex_order, 3, POSITION_BITS, header.position_origin, header.position_step);
+    if (has_uvs)
+    {
+        encode_coordinates(data, *uvs, uv_order, 2, UV_BITS, header.uv_origin, header.uv_step);
+    }
+    header.data_size = data.size();
+
+    OutputFile file(filename);
+    BufferedWriter out(file, 0);
+    out.write(&header, sizeof(header));
+    out.write(data.data(), data.size());
+    out.flush();
+}
+
+template<typename Index>
+BasicFigure<Index> read_compressed_mesh(const char *begin, const char *end, std::vector<Point2d> *uvs,
+                                        std::vector<std::vector<size_t>> *uvfaces)
+{
+    CodecHeader header;
+    read_header(begin, end, header);
+    const char *position = begin + sizeof(header);
+    if (header.version != CODEC_VERSION)
+    {
+        throw std::runtime_error("Compressed mesh: unsupported version " + std::to_string(header.version));
+    }
+    // Every stored value takes at least one byte, so counts that do not fit into data are malformed
+    if (header.data_size > (size_t) (end - position) || header.face_count > header.data_size ||
+        header.vertex_count > header.data_size / 3 || header.uv_count > header.data_size / 2)
+    {
+        throw std::runtime_error("Compressed mesh: counts do not match data size");
+    }
+    if (!BasicFigure<Index>::can_index(header.vertex_count, header.face_count))
+    {
+        throw std::runtime_error("Compressed mesh: too many vertices or faces for index type");
+    }
+    end = position + header.data_size;
+    bool has_uvs = (header.flags & CODEC_HAS_UVS) != 0;
+
+    std::vector<size_t> face_offsets(header.face_count + 1, 0);
+    for (size_t face_id = 0; face_id < header.face_count; ++face_id)
+    {
+        uint64_t size = (header.flags & CODEC_TRIANGLES) != 0 ? 3 : get_varint(position, end);
+        if (size > header.data_size - face_offsets[face_id])
+        {
+            throw std::runtime_error("Compressed mesh: face sizes do not match data size");
+        }
+        face_offsets[face_id + 1] = face_offsets[face_id] + size;
+    }
+    std::vector<Index> indices(face_offsets.back());
+    decode_indices(position, end, header.vertex_count, indices);
+    std::vector<std::vector<size_t>> decoded_uvfaces;
+    if (has_uvs)
+    {
+        std::vector<size_t> uv_indices(face_offsets.back());
+        decode_indices(position, end, header.uv_count, uv_indices);
+        decoded_uvfaces.resize(header.face_count);
+        for (size_t face_id = 0; face_id < header.face_count; ++face_id)
+        {
+            decoded_uvfaces[face_id].assign(uv_indices.begin() + face_offsets[face_id],
+                    uv_indices.begin() + face_offsets[face_id + 1]);
+        }
+    }
+
+    VertexStreams vertices(header.vertex_count);
+    float *const vertex_axes[3] = {vertices.x(), vertices.y(), vertices.z()};
+    decode_coordinates(position, end, 3, header.position_origin, header.position_step, vertex_axes, 1,
+            vertices.size());
+    std::vector<Point2d> decoded_uvs(has_uvs ? header.uv_count : 0);
+    if (has_uvs)
+    {
+        float *uv_values = reinterpret_cast<float *>(decoded_uvs.data());
+        float *const uv_axes[2] = {uv_values, uv_values + 1};
+        decode_coordinates(position, end, 2, header.uv_origin, header.uv_step, uv_axes, 2, decoded_uvs.size());
+    }
+    if (uvs != nullptr && uvfaces != nullptr)
+    {
+        *uvs = std::move(decoded_uvs);
+        *uvfaces = std::move(decoded_uvfaces);
+    }
+    return BasicFigure<Index>(std::move(vertices), std::move(indices), std::move(face_offsets));
+}
+
+template void write_compressed_mesh(const std::string &filename, const Figure32 &figure,
+                                    const std::vector<Point2d> *uvs, const std::vector<std::vector<size_t>> *uvfaces);
+template void write_compressed_mesh(const std::string &filename, const Figure &figure,
+                                    const std::vector<Point2d> *uvs, const std::vector<std::vector<size_t>> *uvfaces);
+template Figure32 read_compressed_mesh(const char *begin, const char *end, std::vector<Point2d> *uvs,
+                                       std::vector<std::vector<size_t>> *uvfaces);
+template Figure read_compressed_mesh(const char *begin, const char *end, std::vector<Point2d> *uvs,
+                                     std::vector<std::vector<size_t>> *uvfaces);
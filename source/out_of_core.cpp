@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "out_of_core.h"
+#include "cutter.h"
+#include "interesting.h"
+#include "mapped_file.h"
+#include "output_file.h"
+#include "parallel.h"
+#include "ply_reader.h"
+
+static const size_t SAMPLE_FACES = 1 << 20;
+static const int MAX_TOP_DEPTH = 10;
+
+/** Approximate peak memory taken while figure is partitioned in memory */
+static size_t partition_memory(size_t vertices, size_t faces, const Parameters &params)
+{
+    size_t index_bytes = Figure32::can_index(vertices, faces) ? sizeof(uint32_t) : sizeof(size_t);
+    // Three indices, offset and cluster id for every face
+    size_t figure_bytes = vertices * sizeof(Point) + faces * (3 * index_bytes + sizeof(size_t) + sizeof(int));
+    // Root node keeps face ids and turned x of vertices for every direction, every running try keeps two events
+    // per face and a buffer of the same size for sorting them
+    size_t event_bytes = vertices <= ((size_t) 1 << 31) ? sizeof(uint64_t) : 2 * sizeof(uint64_t);
+    size_t running_tries = std::min(params.parts, thread_count());
+    size_t scratch_bytes = faces * index_bytes + vertices * params.parts * sizeof(float) +
+                           running_tries * 4 * faces * event_bytes;
+    // Leaves are built from the figure, so both of them exist at the end
+    return 2 * figure_bytes + scratch_bytes;
+}
+
+/** Number of partition tree levels that are built out of core, so that every part fits into memory limit */
+static int top_depth(size_t vertices, size_t faces, const Parameters &params)
+{
+    size_t limit = params.memory_limit << 20;
+    size_t memory = partition_memory(vertices, faces, params);
+    int depth = 0;
+    while ((memory >> depth) > limit && depth < params.depth && depth < MAX_TOP_DEPTH &&
+           (faces >> depth) > params.acceptable_size)
+    {
+        ++depth;
+    }
+    return depth;
+}
+
+bool needs_out_of_core(const std::string &filename, const Parameters &params)
+{
+    if (params.memory_limit == 0)
+    {
+        return false;
+    }
+    // Only the header is read
+    MappedFile file(filename, MAPPED_NORMAL);
+    PlyHeader header;
+    BinaryPlyMesh mesh;
+    return parse_ply_header(file.begin(), file.end(), header) && mesh.open(file.begin(), file.end(), header) &&
+           top_depth(mesh.vertex_count(), mesh.face_count(), params) > 0;
+}
+
+/** Builds figure of every k-th face of `mesh`, so that it has about SAMPLE_FACES faces */
+static Figure sample_figure(const BinaryPlyMesh &mesh)
+{
+    size_t step = std::max<size_t>(1, (mesh.face_count() + SAMPLE_FACES - 1) / SAMPLE_FACES);
+    std::unordered_map<size_t, size_t> new_index;
+    std::vector<Point> vertices;
+    std::vector<size_t> indices;
+    std::vector<size_t> face_offsets(1, 0);
+    mesh.for_each_face([&](size_t face_id, const std::vector<size_t> &face) {
+        if (face_id % step != 0)
+        {
+            return;
+        }
+        for (size_t vertex_id : face)
+        {
+            auto inserted = new_index.insert({vertex_id, vertices.size()});
+            if (inserted.second)
+            {
+                vertices.push_back(mesh.vertex(vertex_id));
+            }
+            indices.push_back(inserted.first->second);
+        }
+        face_offsets.push_back(indices.size());
+    });
+    return Figure(std::move(vertices), std::move(indices), std::move(face_offsets));
+}
+
+/**
+ * Suffix like "_l_r_r" of a node of partition tree
+ * Nodes are numbered as in binary heap: children of `node` are 2 * `node` + 1 and 2 * `node` + 2
+ */
+static std::string node_suffix(size_t node)
+{
+    std::string suffix;
+    while (node != 0)
+    {
+        size_t parent = (node - 1) / 2;
+        suffix = (node == 2 * parent + 1 ? "_l" : "_r") + suffix;
+        node = parent;
+    }
+    return suffix;
+}
+
+/**
+ * Finds cuts of top `top_depth` levels of partition tree on sample figure
+ * Nodes are numbered as in `node_suffix`
+ */
+static void build_cuts(const Figure &sample, size_t node, int depth, int top_depth, std::map<size_t, Cut> &cuts,
+                       const Parameters &params, CutSearchComparison &comparison)
+{
+    if (depth == top_depth)
+    {
+        return;
+    }
+    Cut cut = find_cut(sample, params, node_seed(params.seed, node_suffix(node)), &comparison);
+
+    std::vector<size_t> left;
+    std::vector<size_t> right;
+    std::vector<size_t> cross;
+    std::vector<Point> points;
+    for (size_t face_id = 0; face_id < sample.face_count(); ++face_id)
+    {
+        points.clear();
+        for (size_t vertex_id : sample.face(face_id))
+        {
+            points.push_back(sample.get_vertices()[vertex_id]);
+        }
+        Position position = cut.face_position(points);
+        (position == LEFT ? left : position == RIGHT ? right : cross).push_back(face_id);
+    }
+    for (size_t face_id : cross)
+    {
+        (left.size() < right.size() ? left : right).push_back(face_id);
+    }
+    cuts.emplace(node, cut);
+
+    build_cuts(Figure(sample, left), 2 * node + 1, depth + 1, top_depth, cuts, params, comparison);
+    build_cuts(Figure(sample, right), 2 * node + 2, depth + 1, top_depth, cuts, params, comparison);
+}
+
+/** Loads faces listed in spill file together with vertices they use. Records are read from the mapping in place */
+template<typename Index>
+static BasicFigure<Index> load_spill(const std::string &spill_filename, const BinaryPlyMesh &mesh)
+{
+    MappedFile spill(spill_filename, MAPPED_SEQUENTIAL);
+    const Index *records = reinterpret_cast<const Index *>(spill.begin());
+    size_t record_count = spill.size() / sizeof(Index);
+
+    std::vector<Index> used_vertices;
+    for (size_t position = 0; position < record_count; position += records[position] + 1)
+    {
+        used_vertices.insert(used_vertices.end(), records + position + 1, records + position + 1 + records[position]);
+    }
+    std::sort(used_vertices.begin(), used_vertices.end());
+    used_vertices.erase(std::unique(used_vertices.begin(), used_vertices.end()), used_vertices.end());
+
+    VertexStreams vertices(used_vertices.size());
+    for (size_t i = 0; i < used_vertices.size(); ++i)
+    {
+        vertices.set(i, mesh.vertex(used_vertices[i]));
+    }
+    std::vector<Index> indices;
+    std::vector<size_t> face_offsets(1, 0);
+    for (size_t position = 0; position < record_count; position += records[position] + 1)
+    {
+        for (size_t i = 0; i < records[position]; ++i)
+        {
+            indices.push_back(std::lower_bound(used_vertices.begin(), used_vertices.end(),
+                    records[position + 1 + i]) - used_vertices.begin());
+        }
+        face_offsets.push_back(indices.size());
+    }
+    return BasicFigure<Index>(std::move(vertices), std::move(indices), std::move(face_offsets));
+}
+
+template<typename Index>
+void out_of_core_partition(const std::string &filename, const std::string &save_filename, const Parameters &params,
+                           const std::function<void(std::vector<BasicFigure<Index>> &, const std::string &)>
+                                   &process_part)
+{
+    // Faces are streamed, but their vertices are looked up by id while faces are routed and parts are loaded
+    MappedFile file(filename, MAPPED_NORMAL);
+    PlyHeader header;
+    BinaryPlyMesh mesh;
+    if (!parse_ply_header(file.begin(), file.end(), header) || !mesh.open(file.begin(), file.end(), header))
+    {
+        throw std::runtime_error("Out-of-core mode supports only binary little-endian ply, file " + filename);
+    }
+    int depth = top_depth(mesh.vertex_count(), mesh.face_count(), params);
+    size_t parts = (size_t) 1 << depth;
+    std::cout << "Out-of-core mode: splitting " << filename << " into " << parts << " parts" << std::endl;
+
+    // Top cuts and trees of all parts are summed up in one comparison
+    CutSearchComparison comparison;
+    std::map<size_t, Cut> cuts;
+    {
+        Figure sample = sample_figure(mesh);
+        std::cout << "Finding top cuts on sample of " << sample.face_count() << " faces" << std::endl;
+        build_cuts(sample, 0, 0, depth, cuts, params, comparison);
+    }
+
+    // Every face goes down the tree of cuts into spill file of its part. It is spilled as number of its vertices
+    // followed by their ids, all of type `Index`, so meshes with 32-bit ids take half the disk
+    std::vector<std::string> spill_filenames;
+    std::vector<std::unique_ptr<OutputFile>> spill_files;
+    std::vector<std::unique_ptr<BufferedWriter>> spills;
+    for (size_t part = 0; part < parts; ++part)
+    {
+        spill_filenames.push_back(params.output_filename + ".spill" + std::to_string(part));
+        spill_files.emplace_back(new OutputFile(spill_filenames.back()));
+        spills.emplace_back(new BufferedWriter(*spill_files.back(), 0, 1 << 20));
+    }
+    std::vector<size_t> routed(2 * parts - 1, 0);
+    std::vector<Point> points;
+    mesh.for_each_face([&](size_t, const std::vector<size_t> &face) {
+        points.clear();
+        for (size_t vertex_id : face)
+        {
+            points.push_back(mesh.vertex(vertex_id));
+        }
+        size_t node = 0;
+        for (int level = 0; level < depth; ++level)
+        {
+            Position position = cuts.at(node).face_position(points);
+            size_t left = 2 * node + 1;
+            size_t right = 2 * node + 2;
+            if (position == CROSS)
+            {
+                position = routed[left] < routed[right] ? LEFT : RIGHT;
+            }
+            node = position == LEFT ? left : right;
+            ++routed[node];
+        }
+        BufferedWriter &spill = *spills[node - (parts - 1)];
+        spill.put<Index>(face.size());
+        for (size_t vertex_id : face)
+        {
+            spill.put<Index>(vertex_id);
+        }
+    });
+    for (std::unique_ptr<BufferedWriter> &spill : spills)
+    {
+        spill->flush();
+    }
+    spills.clear();
+    spill_files.clear();
+
+    std::mutex mutex;
+    for (size_t part = 0; part < parts; ++part)
+    {
+        std::string part_suffix = node_suffix(part + parts - 1);
+        std::vector<BasicFigure<Index>> division;
+        {
+            BasicFigure<Index> figure = load_spill<Index>(spill_filenames[part], mesh);
+            std::remove(spill_filenames[part].c_str());
+            if (params.clusterization)
+            {
+                figure.set_clusters(divide_interesting(figure, params, node_seed(params.seed, part_suffix)));
+            }
+            partition(figure, depth, save_filename + part_suffix, division, mutex, params, comparison);
+        }
+        // The part itself is freed, only its subfigures are processed
+        process_part(division, part_suffix);
+    }
+    if (params.cut_search == CUT_SEARCH_COMPARE)
+    {
+        comparison.print();
+    }
+}
+
+template void out_of_core_partition(const std::string &filename, const std::string &save_filename,
+                                    const Parameters &params,
+                                    const std::function<void(std::vector<Figure32> &, const std::string &)>
+                                            &process_part);
+template void out_of_core_partition(const std::string &filename, const std::string &save_filename,
+                                    const Parameters &params,
+                                    const std::function<void(std::vector<Figure> &, const std::string &)>
+                                            &process_part);
@@ -0,0 +1,75 @@
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include "output_file.h"
+
+OutputFile::OutputFile(const std::string &filename) : filename(filename)
+{
+    fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Could not open output file " + filename + " for writing");
+    }
+}
+
+OutputFile::~OutputFile()
+{
+    close(fd);
+}
+
+void OutputFile::preallocate(size_t size)
+{
+    // Not every file system supports allocation, then file is only extended
+    if (posix_fallocate(fd, 0, size) != 0 && ftruncate(fd, size) != 0)
+    {
+        throw std::runtime_error("Could not allocate " + std::to_string(size) + " bytes for " + filename);
+    }
+}
+
+void OutputFile::write_at(const void *data, size_t size, size_t offset)
+{
+    const char *position = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        ssize_t written = pwrite(fd, position, size, offset);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            throw std::runtime_error("Could not write to " + filename);
+        }
+        position += written;
+        offset += written;
+        size -= written;
+    }
+}
+
+BufferedWriter::BufferedWriter(OutputFile &file, size_t offset, size_t capacity) : file(file),
+                                                                                    offset(offset),
+                                                                                    buffer(capacity) {}
+
+void BufferedWriter::write(const void *data, size_t size)
+{
+    if (buffer.size() - used < size)
+    {
+        flush();
+    }
+    if (size >= buffer.size())
+    {
+        file.write_at(data, size, offset);
+        offset += size;
+        return;
+    }
+    std::memcpy(buffer.data() + used, data, size);
+    used += size;
+}
+
+void BufferedWriter::flush()
+{
+    file.write_at(buffer.data(), used, offset);
+    offset += used;
+    used = 0;
+}
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "parallel.h"
+
+static size_t requested_threads = 0;
+
+void set_thread_count(size_t threads)
+{
+    requested_threads = threads;
+}
+
+size_t thread_count()
+{
+    static const size_t threads = requested_threads != 0 ? requested_threads
+                                                         : std::max(1u, std::thread::hardware_concurrency());
+    return threads;
+}
+
+class Task {
+public:
+    std::function<void()> body;
+    TaskGroup *group;
+};
+
+/** Tasks spawned by one thread. Owner takes them from the back, other threads steal from the front */
+class TaskQueue {
+public:
+    std::mutex mutex;
+    std::deque<Task> tasks;
+};
+
+class ThreadPool {
+private:
+    /**
+     * Queue 0 is shared by threads that are not workers of the pool. They take from it only tasks of the group they
+     * wait for, so that e.g. a saving thread waiting for its loop does not run a task that waits for the saving
+     */
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued{0};
+    bool stopping = false;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+
+    void work(size_t worker_id);
+    bool pop(size_t queue_id, bool own, Task &task);
+    bool pop_group(const TaskGroup *group, Task &task);
+    bool has_group_task(const TaskGroup *group);
+
+public:
+    explicit ThreadPool(size_t worker_count);
+    ~ThreadPool();
+
+    void push(Task task);
+    /** Runs one pending task if there is any. Threads that are not workers run only tasks of `group` */
+    bool run_one(const TaskGroup *group);
+    /** Blocks until some task `run_one(group)` can run is queued or `done` returns true */
+    void sleep(const TaskGroup *group, const std::function<bool()> &done);
+    /** Wakes up threads sleeping in `sleep` */
+    void notify();
+};
+
+/** Queue of tasks spawned by the calling thread */
+static thread_local size_t queue_id = 0;
+
+ThreadPool::ThreadPool(size_t worker_count)
+{
+    for (size_t queue = 0; queue <= worker_count; ++queue)
+    {
+        queues.emplace_back(new TaskQueue());
+    }
+    for (size_t worker = 1; worker <= worker_count; ++worker)
+    {
+        workers.emplace_back(&ThreadPool::work, this, worker);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::work(size_t worker_id)
+{
+    queue_id = worker_id;
+    while (true)
+    {
+        if (run_one(nullptr))
+        {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this]() { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+        {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::pop(size_t queue, bool own, Task &task)
+{
+    std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+    std::deque<Task> &tasks = queues[queue]->tasks;
+    if (tasks.empty())
+    {
+        return false;
+    }
+    if (own)
+    {
+        task = std::move(tasks.back());
+        tasks.pop_back();
+    }
+    else
+    {
+        task = std::move(tasks.front());
+        tasks.pop_front();
+    }
+    --queued;
+    return true;
+}
+
+bool ThreadPool::pop_group(const TaskGroup *group, Task &task)
+{
+    std::lock_guard<std::mutex> lock(queues[0]->mutex);
+    std::deque<Task> &tasks = queues[0]->tasks;
+    for (auto it = tasks.rbegin(); it != tasks.rend(); ++it)
+    {
+        if (it->group == group)
+        {
+            task = std::move(*it);
+            tasks.erase(std::next(it).base());
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::has_group_task(const TaskGroup *group)
+{
+    std::lock_guard<std::mutex> lock(queues[0]->mutex);
+    const std::deque<Task> &tasks = queues[0]->tasks;
+    return std::any_of(tasks.begin(), tasks.end(), [group](const Task &task) { return task.group == group; });
+}
+
+void ThreadPool::push(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(queues[queue_id]->mutex);
+        queues[queue_id]->tasks.push_back(std::move(task));
+        ++queued;
+    }
+    notify();
+}
+
+bool ThreadPool::run_one(const TaskGroup *group)
+{
+    Task task;
+    bool found = false;
+    if (queue_id == 0)
+    {
+        found = pop_group(group, task);
+    }
+    else
+    {
+        found = pop(queue_id, true, task);
+        for (size_t shift = 1; shift < queues.size() && !found; ++shift)
+        {
+            found = pop((queue_id + shift) % queues.size(), false, task);
+        }
+    }
+    if (!found)
+    {
+        return false;
+    }
+    std::exception_ptr error;
+    try
+    {
+        task.body();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    task.group->finish_task(error);
+    return true;
+}
+
+void ThreadPool::sleep(const TaskGroup *group, const std::function<bool()> &done)
+{
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    wake.wait(lock, [&]() { return (queue_id == 0 ? has_group_task(group) : queued > 0) || done(); });
+}
+
+void ThreadPool::notify()
+{
+    // Taking the mutex orders the change the sleepers wait for before their check of it
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_all();
+}
+
+static ThreadPool &thread_pool()
+{
+    static ThreadPool pool(thread_count() - 1);
+    return pool;
+}
+
+TaskGroup::~TaskGroup()
+{
+    wait_tasks();
+}
+
+void TaskGroup::run(std::function<void()> task)
+{
+    ++pending;
+    thread_pool().push({std::move(task), this});
+}
+
+void TaskGroup::wait_tasks()
+{
+    while (pending > 0)
+    {
+        if (!thread_pool().run_one(this))
+        {
+            thread_pool().sleep(this, [this]() { return pending == 0; });
+        }
+    }
+}
+
+void TaskGroup::wait()
+{
+    wait_tasks();
+    std::exception_ptr task_error;
+    {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        std::swap(task_error, error);
+    }
+    if (task_error)
+    {
+        std::rethrow_exception(task_error);
+    }
+}
+
+void TaskGroup::finish_task(std::exception_ptr task_error)
+{
+    if (task_error)
+    {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error)
+        {
+            error = task_error;
+        }
+    }
+    if (--pending == 0)
+    {
+        thread_pool().notify();
+    }
+}
+
+void parallel_for(size_t size, size_t min_range, const std::function<void(size_t, size_t)> &body)
+{
+    size_t ranges = std::min(thread_count(), size / std::max<size_t>(min_range, 1));
+    if (ranges <= 1)
+    {
+        body(0, size);
+        return;
+    }
+
+    TaskGroup group;
+    for (size_t range = 0; range < ranges; ++range)
+    {
+        size_t begin = size * range / ranges;
+        size_t end = size * (range + 1) / ranges;
+        group.run([&body, begin, end]() { body(begin, end); });
+    }
+    group.wait();
+}
@@ -1,5 +1,6 @@
 #include "parser.h"
 #include <iostream>
+#include <random>
 
 Parameters parse_parameters(int argc, char ** argv)
 {
@@ -88,6 +89,87 @@ Parameters parse_parameters(int argc, char ** argv)
         {
             params.save_partition = true;
         }
+        else if (std::string(argv[i]) == "--sequential-write")
+        {
+            params.parallel_write = false;
+        }
+        else if (std::string(argv[i]) == "--compact-output")
+        {
+            params.compact_output = true;
+        }
+        else if (std::string(argv[i]) == "--compress-output")
+        {
+            params.compress_output = true;
+        }
+        else if (std::string(argv[i]) == "--cache")
+        {
+            params.use_cache = true;
+        }
+        else if (std::string(argv[i]) == "--no-cache")
+        {
+            params.use_cache = false;
+        }
+        else if (std::string(argv[i]) == "--memory-limit")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "INT expected after --memory-limit." << std::endl;
+                abort();
+            }
+            params.memory_limit = atoi(argv[i + 1]);
+            ++i;
+        }
+        else if (std::string(argv[i]) == "--benchmark-kernels")
+        {
+            params.benchmark_kernels = true;
+        }
+        else if (std::string(argv[i]) == "--cut-search")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "exact, histogram or compare expected after --cut-search." << std::endl;
+                abort();
+            }
+            std::string search = argv[i + 1];
+            if (search == "exact")
+            {
+                params.cut_search = CUT_SEARCH_EXACT;
+            }
+            else if (search == "histogram")
+            {
+                params.cut_search = CUT_SEARCH_HISTOGRAM;
+            }
+            else if (search == "compare")
+            {
+                params.cut_search = CUT_SEARCH_COMPARE;
+            }
+            else
+            {
+                std::cerr << "exact, histogram or compare expected after --cut-search." << std::endl;
+                abort();
+            }
+            ++i;
+        }
+        else if (std::string(argv[i]) == "--threads")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "INT expected after --threads." << std::endl;
+                abort();
+            }
+            params.threads = atoi(argv[i + 1]);
+            ++i;
+        }
+        else if (std::string(argv[i]) == "--seed")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "INT expected after --seed." << std::endl;
+                abort();
+            }
+            params.seed = strtoull(argv[i + 1], nullptr, 10);
+            ++i;
+        }
         else
         {
             std::cerr << "Unexpected token " << argv[i] << std::endl;
@@ -98,6 +180,11 @@ Parameters parse_parameters(int argc, char ** argv)
     {
         params.output_filename = "uv_" + params.filename;
     }
+    if (params.seed == 0)
+    {
+        std::random_device device;
+        params.seed = ((uint64_t) device() << 32) | device();
+    }
     if (params.cluster_min_size > params.cluster_max_size)
     {
         std::cerr << "Wrong arguments! Min size of cluster cannot be more than max." << std::endl;
@@ -131,3 +218,13 @@ std::string Parameters::to_string() const
         std::to_string(cluster_max_size) + "_" +
         std::to_string(optimize_clusters);
 }
+
+std::string Parameters::clustering_to_string() const
+{
+    // Clusters are optimized with random directions, so they depend on the seed too
+    return std::to_string(clusterization) + "_" +
+        std::to_string(cluster_min_size) + "_" +
+        std::to_string(cluster_max_size) + "_" +
+        std::to_string(optimize_clusters) +
+        (optimize_clusters ? "_" + std::to_string(seed) : "");
+}
@@ -1,59 +1,96 @@
 #include "happly.h"
 #include "figure.h"
 #include "ply.h"
+#include "ply_reader.h"
+#include "ply_writer.h"
+#include "mapped_file.h"
+#include "mesh_codec.h"
 #include <vector>
 #include <string>
 
-Figure read_mesh(const std::string &path_to_ply)
+bool read_mesh_size(const std::string &path_to_ply, size_t &vertex_count, size_t &face_count)
 {
-    happly::PLYData plyIn(path_to_ply);
-    return Figure(plyIn.getVertexPositions(), plyIn.getFaceIndices<size_t>());
+    // Only the header is read
+    MappedFile file(path_to_ply, MAPPED_NORMAL);
+    if (is_compressed_mesh(file.begin(), file.end()))
+    {
+        read_compressed_mesh_size(file.begin(), file.end(), vertex_count, face_count);
+        return true;
+    }
+    PlyHeader header;
+    if (!parse_ply_header(file.begin(), file.end(), header))
+    {
+        return false;
+    }
+    vertex_count = 0;
+    face_count = 0;
+    for (const PlyElement &element : header.elements)
+    {
+        if (element.name == "vertex")
+        {
+            vertex_count = element.count;
+        }
+        else if (element.name == "face")
+        {
+            face_count = element.count;
+        }
+    }
+    return true;
 }
 
-void save_figure(const Figure& figure, const std::string& filename)
+template<typename Index>
+BasicFigure<Index> read_mesh(const std::string &path_to_ply)
 {
-    std::vector<std::array<double, 3>> vertices;
-    vertices.reserve(figure.get_vertices().size());
-    for (const Point& point : figure.get_vertices())
     {
-        vertices.push_back({point.x, point.y, point.z});
+        MappedFile file(path_to_ply, MAPPED_SEQUENTIAL);
+        if (is_compressed_mesh(file.begin(), file.end()))
+        {
+            return read_compressed_mesh<Index>(file.begin(), file.end());
+        }
+        PlyHeader header;
+        VertexStreams vertices;
+        std::vector<Index> indices;
+        std::vector<size_t> face_offsets;
+        if (parse_ply_header(file.begin(), file.end(), header) &&
+            (read_binary_mesh(file.begin(), file.end(), header, vertices, indices, face_offsets) ||
+             read_ascii_mesh(file.begin(), file.end(), header, vertices, indices, face_offsets)))
+        {
+            return BasicFigure<Index>(std::move(vertices), std::move(indices), std::move(face_offsets));
+        }
     }
-    happly::PLYData plyOut;
+    // Layout is not supported by the mapped reader
+    happly::PLYData plyIn(path_to_ply);
+    return BasicFigure<Index>(plyIn.getVertexPositions(), plyIn.getFaceIndices<size_t>());
+}
+
+template Figure32 read_mesh(const std::string &path_to_ply);
+template Figure read_mesh(const std::string &path_to_ply);
 
-    plyOut.addVertexPositions(vertices);
-    std::vector<std::vector<size_t>> faces = figure.get_faces();
-    plyOut.addFaceIndices(faces);
-    plyOut.write(filename, happly::DataFormat::Binary);
+static PlySchema output_schema(const Parameters &params)
+{
+    return params.compact_output ? PLY_SCHEMA_COMPACT : PLY_SCHEMA_HAPPLY;
 }
 
-void save_figure(ParametrizedFigure &figure, const std::string &filename) {
-    std::vector<std::array<double, 3>> vertices;
-    vertices.reserve(figure.get_vertices().size());
-    for (const Point& point : figure.get_vertices())
+template<typename Index>
+void save_figure(const BasicFigure<Index> &figure, const std::string &filename, const Parameters &params)
+{
+    if (params.compress_output)
     {
-        vertices.push_back({point.x, point.y, point.z});
+        write_compressed_mesh(filename, figure);
+        return;
     }
-    happly::PLYData plyOut;
-
-    plyOut.addVertexPositions(vertices);
-    std::vector<std::vector<size_t>> faces = figure.get_faces();
-    plyOut.addFaceIndices(faces);
+    write_ply(filename, figure, params.parallel_write, output_schema(params));
+}
 
-    std::vector<std::vector<float>> texcoords;
-    texcoords.reserve(figure.get_uvfaces().size());
+template void save_figure(const Figure32 &figure, const std::string &filename, const Parameters &params);
+template void save_figure(const Figure &figure, const std::string &filename, const Parameters &params);
 
-    for (const auto &face : figure.get_uvfaces())
+void save_figure(ParametrizedFigure &figure, const std::string &filename, const Parameters &params) {
+    if (params.compress_output)
     {
-        std::vector<float> new_texcoords;
-        new_texcoords.reserve(6);
-        for (int v_id = 0; v_id < 3; ++v_id)
-        {
-            const size_t &vertex = face[v_id];
-            new_texcoords.push_back(figure.get_uvs()[vertex].x);
-            new_texcoords.push_back(figure.get_uvs()[vertex].y);
-        }
-        texcoords.push_back(new_texcoords);
+        write_compressed_mesh(filename, figure, &figure.get_uvs(), &figure.get_uvfaces());
+        return;
     }
-    plyOut.getElement("face").addListProperty("texcoord", texcoords);
-    plyOut.write(filename, happly::DataFormat::Binary);
+    write_ply(filename, figure, params.parallel_write, output_schema(params), &figure.get_uvs(),
+            &figure.get_uvfaces());
 }
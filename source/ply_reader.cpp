@@ -0,0 +1,1074 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include "ply_reader.h"
+#include "parallel.h"
+
+static_assert(std::is_trivially_copyable<Point>::value && sizeof(Point) == 3 * sizeof(float),
+        "Point must be three packed floats, so that packed coordinates of a record are decoded by one copy "
+        "before they are split between vertex streams");
+
+size_t ply_type_size(PlyType type)
+{
+    switch (type)
+    {
+        case PLY_INT8:
+        case PLY_UINT8:
+            return 1;
+        case PLY_INT16:
+        case PLY_UINT16:
+            return 2;
+        case PLY_INT32:
+        case PLY_UINT32:
+        case PLY_FLOAT32:
+            return 4;
+        case PLY_FLOAT64:
+            return 8;
+    }
+    return 0;
+}
+
+size_t PlyElement::stride() const
+{
+    size_t size = 0;
+    for (const PlyProperty &property : properties)
+    {
+        if (property.is_list)
+        {
+            return 0;
+        }
+        size += ply_type_size(property.type);
+    }
+    return size;
+}
+
+int PlyElement::find_property(const std::string &name) const
+{
+    for (size_t property_id = 0; property_id < properties.size(); ++property_id)
+    {
+        if (properties[property_id].name == name)
+        {
+            return (int) property_id;
+        }
+    }
+    return -1;
+}
+
+static bool parse_ply_type(const std::string &name, PlyType &type)
+{
+    if (name == "char" || name == "int8")
+    {
+        type = PLY_INT8;
+    }
+    else if (name == "uchar" || name == "uint8")
+    {
+        type = PLY_UINT8;
+    }
+    else if (name == "short" || name == "int16")
+    {
+        type = PLY_INT16;
+    }
+    else if (name == "ushort" || name == "uint16")
+    {
+        type = PLY_UINT16;
+    }
+    else if (name == "int" || name == "int32")
+    {
+        type = PLY_INT32;
+    }
+    else if (name == "uint" || name == "uint32")
+    {
+        type = PLY_UINT32;
+    }
+    else if (name == "float" || name == "float32")
+    {
+        type = PLY_FLOAT32;
+    }
+    else if (name == "double" || name == "float64")
+    {
+        type = PLY_FLOAT64;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+static bool is_integer_type(PlyType type)
+{
+    return type != PLY_FLOAT32 && type != PLY_FLOAT64;
+}
+
+static std::vector<std::string> split_tokens(const char *begin, const char *end)
+{
+    std::vector<std::string> tokens;
+    const char *position = begin;
+    while (position < end)
+    {
+        while (position < end && std::isspace((unsigned char) *position))
+        {
+            ++position;
+        }
+        const char *token_end = position;
+        while (token_end < end && !std::isspace((unsigned char) *token_end))
+        {
+            ++token_end;
+        }
+        if (token_end > position)
+        {
+            tokens.emplace_back(position, token_end);
+        }
+        position = token_end;
+    }
+    return tokens;
+}
+
+bool parse_ply_header(const char *begin, const char *end, PlyHeader &header)
+{
+    header = PlyHeader();
+    bool has_format = false;
+    bool first_line = true;
+    const char *position = begin;
+    while (position < end)
+    {
+        const char *line_end = std::find(position, end, '\n');
+        if (line_end == end)
+        {
+            return false;
+        }
+        std::vector<std::string> tokens = split_tokens(position, line_end);
+        position = line_end + 1;
+
+        if (first_line)
+        {
+            if (tokens.size() != 1 || tokens[0] != "ply")
+            {
+                return false;
+            }
+            first_line = false;
+            continue;
+        }
+        if (tokens.empty())
+        {
+            continue;
+        }
+
+        const std::string &keyword = tokens[0];
+        if (keyword == "comment" || keyword == "obj_info")
+        {
+            continue;
+        }
+        else if (keyword == "format")
+        {
+            if (tokens.size() != 3 || tokens[2] != "1.0")
+            {
+                return false;
+            }
+            if (tokens[1] == "ascii")
+            {
+                header.format = PLY_ASCII;
+            }
+            else if (tokens[1] == "binary_little_endian")
+            {
+                header.format = PLY_BINARY_LITTLE_ENDIAN;
+            }
+            else if (tokens[1] == "binary_big_endian")
+            {
+                header.format = PLY_BINARY_BIG_ENDIAN;
+            }
+            else
+            {
+                return false;
+            }
+            has_format = true;
+        }
+        else if (keyword == "element")
+        {
+            if (tokens.size() != 3)
+            {
+                return false;
+            }
+            char *count_end = nullptr;
+            PlyElement element;
+            element.name = tokens[1];
+            element.count = std::strtoull(tokens[2].c_str(), &count_end, 10);
+            if (*count_end != '\0')
+            {
+                return false;
+            }
+            header.elements.push_back(element);
+        }
+        else if (keyword == "property")
+        {
+            if (header.elements.empty())
+            {
+                return false;
+            }
+            PlyProperty property;
+            if (tokens.size() == 5 && tokens[1] == "list")
+            {
+                property.is_list = true;
+                if (!parse_ply_type(tokens[2], property.count_type) || !is_integer_type(property.count_type) ||
+                    !parse_ply_type(tokens[3], property.type))
+                {
+                    return false;
+                }
+                property.name = tokens[4];
+            }
+            else if (tokens.size() == 3)
+            {
+                if (!parse_ply_type(tokens[1], property.type))
+                {
+                    return false;
+                }
+                property.name = tokens[2];
+            }
+            else
+            {
+                return false;
+            }
+            header.elements.back().properties.push_back(property);
+        }
+        else if (keyword == "end_header")
+        {
+            header.data_offset = position - begin;
+            return has_format;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+template<typename T>
+static inline T load(const char *data)
+{
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+static inline double load_as_double(const char *data, PlyType type)
+{
+    switch (type)
+    {
+        case PLY_INT8: return load<int8_t>(data);
+        case PLY_UINT8: return load<uint8_t>(data);
+        case PLY_INT16: return load<int16_t>(data);
+        case PLY_UINT16: return load<uint16_t>(data);
+        case PLY_INT32: return load<int32_t>(data);
+        case PLY_UINT32: return load<uint32_t>(data);
+        case PLY_FLOAT32: return load<float>(data);
+        case PLY_FLOAT64: return load<double>(data);
+    }
+    return 0;
+}
+
+/** Converts signed values the same naive way happly does, so both readers agree on malformed files */
+static inline size_t load_as_index(const char *data, PlyType type)
+{
+    switch (type)
+    {
+        case PLY_INT8: return static_cast<size_t>(load<int8_t>(data));
+        case PLY_UINT8: return load<uint8_t>(data);
+        case PLY_INT16: return static_cast<size_t>(load<int16_t>(data));
+        case PLY_UINT16: return load<uint16_t>(data);
+        case PLY_INT32: return static_cast<size_t>(load<int32_t>(data));
+        case PLY_UINT32: return load<uint32_t>(data);
+        default: return 0;
+    }
+}
+
+bool is_little_endian()
+{
+    uint32_t value = 1;
+    char first_byte;
+    std::memcpy(&first_byte, &value, 1);
+    return first_byte == 1;
+}
+
+/** Returns pointer after the records of `element` that start at `data` or nullptr if data is truncated */
+static const char *skip_element(const PlyElement &element, const char *data, const char *end)
+{
+    size_t stride = element.stride();
+    if (stride != 0)
+    {
+        if ((size_t) (end - data) / stride < element.count)
+        {
+            return nullptr;
+        }
+        return data + stride * element.count;
+    }
+    for (size_t record = 0; record < element.count; ++record)
+    {
+        for (const PlyProperty &property : element.properties)
+        {
+            size_t value_size = ply_type_size(property.type);
+            size_t values = 1;
+            if (property.is_list)
+            {
+                size_t count_size = ply_type_size(property.count_type);
+                if ((size_t) (end - data) < count_size)
+                {
+                    return nullptr;
+                }
+                values = load_as_index(data, property.count_type);
+                data += count_size;
+            }
+            if ((size_t) (end - data) / value_size < values)
+            {
+                return nullptr;
+            }
+            data += values * value_size;
+        }
+    }
+    return data;
+}
+
+PlyVertexLayout::PlyVertexLayout(const PlyElement &element) : stride(element.stride())
+{
+    const char *names[3] = {"x", "y", "z"};
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        int property_id = element.find_property(names[axis]);
+        for (int previous = 0; previous < property_id; ++previous)
+        {
+            offsets[axis] += ply_type_size(element.properties[previous].type);
+        }
+        types[axis] = element.properties[property_id].type;
+    }
+    packed_floats = types[0] == PLY_FLOAT32 && types[1] == PLY_FLOAT32 && types[2] == PLY_FLOAT32 &&
+                    offsets[1] == offsets[0] + 4 && offsets[2] == offsets[0] + 8;
+}
+
+Point PlyVertexLayout::decode(const char *record) const
+{
+    Point vertex;
+    if (packed_floats)
+    {
+        std::memcpy(&vertex, record + offsets[0], sizeof(Point));
+        return vertex;
+    }
+    vertex.x = (float) load_as_double(record + offsets[0], types[0]);
+    vertex.y = (float) load_as_double(record + offsets[1], types[1]);
+    vertex.z = (float) load_as_double(record + offsets[2], types[2]);
+    return vertex;
+}
+
+/** Splits vertex records into coordinate streams in parallel */
+static void decode_vertices(const PlyElement &element, const char *data, VertexStreams &vertices)
+{
+    static const size_t MIN_RANGE = 1 << 16;
+
+    PlyVertexLayout layout(element);
+    vertices = VertexStreams(element.count);
+    parallel_for(element.count, MIN_RANGE, [&](size_t first, size_t last) {
+        for (size_t vertex_id = first; vertex_id < last; ++vertex_id)
+        {
+            vertices.set(vertex_id, layout.decode(data + vertex_id * layout.stride));
+        }
+    });
+}
+
+/**
+ * Decodes list property `indices_id` of the face record that starts at `data` into `face`
+ * Returns pointer after the record or nullptr if data is truncated
+ */
+static const char *decode_face_record(const PlyElement &element, size_t indices_id, const char *data,
+                                      const char *end, std::vector<size_t> &face)
+{
+    for (size_t property_id = 0; property_id < element.properties.size(); ++property_id)
+    {
+        const PlyProperty &property = element.properties[property_id];
+        size_t value_size = ply_type_size(property.type);
+        size_t values = 1;
+        if (property.is_list)
+        {
+            size_t count_size = ply_type_size(property.count_type);
+            if ((size_t) (end - data) < count_size)
+            {
+                return nullptr;
+            }
+            values = load_as_index(data, property.count_type);
+            data += count_size;
+        }
+        if ((size_t) (end - data) / value_size < values)
+        {
+            return nullptr;
+        }
+        if (property_id == indices_id)
+        {
+            face.resize(values);
+            for (size_t i = 0; i < values; ++i)
+            {
+                face[i] = load_as_index(data + i * value_size, property.type);
+            }
+        }
+        data += values * value_size;
+    }
+    return data;
+}
+
+/** Same as `skip_element`, but also decodes list property `indices_id` of every record into flat faces */
+template<typename Index>
+static const char *decode_faces(const PlyElement &element, size_t indices_id, const char *data, const char *end,
+                                std::vector<Index> &indices, std::vector<size_t> &face_offsets)
+{
+    std::vector<size_t> face;
+    indices.clear();
+    face_offsets.assign(1, 0);
+    face_offsets.reserve(element.count + 1);
+    for (size_t face_id = 0; face_id < element.count; ++face_id)
+    {
+        data = decode_face_record(element, indices_id, data, end, face);
+        if (data == nullptr)
+        {
+            return nullptr;
+        }
+        indices.insert(indices.end(), face.begin(), face.end());
+        face_offsets.push_back(indices.size());
+    }
+    return data;
+}
+
+/**
+ * Decodes faces in parallel assuming every face is a triangle, so that all records have the same size
+ * Returns pointer after the face records or nullptr if the assumption does not hold
+ */
+template<typename Index>
+static const char *decode_triangles(const PlyElement &element, size_t indices_id, const char *data,
+                                    const char *end, std::vector<Index> &indices, std::vector<size_t> &face_offsets)
+{
+    static const size_t SAMPLES = 64;
+    static const size_t MIN_RANGE = 1 << 16;
+
+    // Record layout if every list of indices has three values
+    size_t stride = 0;
+    size_t count_offset = 0;
+    const PlyProperty &indices_property = element.properties[indices_id];
+    size_t index_size = ply_type_size(indices_property.type);
+    for (size_t property_id = 0; property_id < element.properties.size(); ++property_id)
+    {
+        const PlyProperty &property = element.properties[property_id];
+        if (property_id == indices_id)
+        {
+            count_offset = stride;
+            stride += ply_type_size(property.count_type) + 3 * index_size;
+        }
+        else if (property.is_list)
+        {
+            return nullptr;
+        }
+        else
+        {
+            stride += ply_type_size(property.type);
+        }
+    }
+    size_t indices_offset = count_offset + ply_type_size(indices_property.count_type);
+    if ((size_t) (end - data) / stride < element.count)
+    {
+        return nullptr;
+    }
+
+    // Cheap rejection of polygonal meshes before the full pass
+    size_t samples = std::min(SAMPLES, element.count);
+    for (size_t sample = 0; sample < samples; ++sample)
+    {
+        const char *record = data + (sample * element.count / samples) * stride;
+        if (load_as_index(record + count_offset, indices_property.count_type) != 3)
+        {
+            return nullptr;
+        }
+    }
+
+    // Every record is still checked: if all counts at fixed offsets are 3, the sequential parse is the same
+    std::atomic<bool> all_triangles(true);
+    indices.resize(3 * element.count);
+    face_offsets.clear();
+    parallel_for(element.count, MIN_RANGE, [&](size_t first, size_t last) {
+        for (size_t face_id = first; face_id < last; ++face_id)
+        {
+            const char *record = data + face_id * stride;
+            if (load_as_index(record + count_offset, indices_property.count_type) != 3)
+            {
+                all_triangles = false;
+                return;
+            }
+            const char *values = record + indices_offset;
+            for (size_t i = 0; i < 3; ++i)
+            {
+                indices[3 * face_id + i] = (Index) load_as_index(values + i * index_size, indices_property.type);
+            }
+        }
+    });
+    if (!all_triangles)
+    {
+        return nullptr;
+    }
+    return data + stride * element.count;
+}
+
+static const PlyElement *find_element(const PlyHeader &header, const std::string &name)
+{
+    for (const PlyElement &element : header.elements)
+    {
+        if (element.name == name)
+        {
+            return &element;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Finds elements with vertex positions and faces, and the list property with indices of face vertices
+ * Returns false if mesh cannot be decoded from them
+ */
+static bool find_mesh_elements(const PlyHeader &header, const PlyElement *&vertex_element,
+                               const PlyElement *&face_element, int &indices_id)
+{
+    vertex_element = find_element(header, "vertex");
+    face_element = find_element(header, "face");
+    if (vertex_element == nullptr || face_element == nullptr)
+    {
+        return false;
+    }
+    for (const char *name : {"x", "y", "z"})
+    {
+        int property_id = vertex_element->find_property(name);
+        if (property_id == -1 || vertex_element->properties[property_id].is_list ||
+            is_integer_type(vertex_element->properties[property_id].type))
+        {
+            return false;
+        }
+    }
+    indices_id = face_element->find_property("vertex_indices");
+    if (indices_id == -1)
+    {
+        indices_id = face_element->find_property("vertex_index");
+    }
+    return indices_id != -1 && face_element->properties[indices_id].is_list &&
+           is_integer_type(face_element->properties[indices_id].type);
+}
+
+template<typename Index>
+bool read_binary_mesh(const char *begin, const char *end, const PlyHeader &header, VertexStreams &vertices,
+                      std::vector<Index> &indices, std::vector<size_t> &face_offsets)
+{
+    const PlyElement *vertex_element;
+    const PlyElement *face_element;
+    int indices_id;
+    if (header.format != PLY_BINARY_LITTLE_ENDIAN || !is_little_endian() ||
+        !find_mesh_elements(header, vertex_element, face_element, indices_id) || vertex_element->stride() == 0)
+    {
+        return false;
+    }
+
+    const char *data = begin + header.data_offset;
+    for (const PlyElement &element : header.elements)
+    {
+        if (&element == vertex_element)
+        {
+            const char *vertices_end = skip_element(element, data, end);
+            if (vertices_end != nullptr)
+            {
+                decode_vertices(element, data, vertices);
+            }
+            data = vertices_end;
+        }
+        else if (&element == face_element)
+        {
+            const char *faces_end = decode_triangles(element, indices_id, data, end, indices, face_offsets);
+            data = faces_end != nullptr ? faces_end
+                                        : decode_faces(element, indices_id, data, end, indices, face_offsets);
+        }
+        else
+        {
+            data = skip_element(element, data, end);
+        }
+        if (data == nullptr)
+        {
+            throw std::runtime_error("PLY reader: unexpected end of file in element " + element.name);
+        }
+    }
+    return true;
+}
+
+template bool read_binary_mesh(const char *begin, const char *end, const PlyHeader &header,
+                               VertexStreams &vertices, std::vector<uint32_t> &indices,
+                               std::vector<size_t> &face_offsets);
+template bool read_binary_mesh(const char *begin, const char *end, const PlyHeader &header,
+                               VertexStreams &vertices, std::vector<size_t> &indices,
+                               std::vector<size_t> &face_offsets);
+
+bool BinaryPlyMesh::open(const char *begin, const char *end, const PlyHeader &header)
+{
+    if (header.format != PLY_BINARY_LITTLE_ENDIAN || !is_little_endian() ||
+        !find_mesh_elements(header, vertex_element, face_element, indices_id) || vertex_element->stride() == 0)
+    {
+        return false;
+    }
+    const char *data = begin + header.data_offset;
+    for (const PlyElement &element : header.elements)
+    {
+        if (&element == vertex_element)
+        {
+            vertex_data = data;
+        }
+        else if (&element == face_element)
+        {
+            face_data = data;
+        }
+        data = skip_element(element, data, end);
+        if (data == nullptr)
+        {
+            throw std::runtime_error("PLY reader: unexpected end of file in element " + element.name);
+        }
+    }
+    this->end = end;
+    layout = PlyVertexLayout(*vertex_element);
+    return true;
+}
+
+size_t BinaryPlyMesh::vertex_count() const
+{
+    return vertex_element->count;
+}
+
+size_t BinaryPlyMesh::face_count() const
+{
+    return face_element->count;
+}
+
+Point BinaryPlyMesh::vertex(size_t vertex_id) const
+{
+    return layout.decode(vertex_data + vertex_id * layout.stride);
+}
+
+void BinaryPlyMesh::for_each_face(const std::function<void(size_t, const std::vector<size_t> &)> &callback) const
+{
+    std::vector<size_t> face;
+    const char *data = face_data;
+    for (size_t face_id = 0; face_id < face_element->count; ++face_id)
+    {
+        data = decode_face_record(*face_element, indices_id, data, end, face);
+        callback(face_id, face);
+    }
+}
+
+static inline bool is_blank(char symbol)
+{
+    return symbol == ' ' || symbol == '\t' || symbol == '\r';
+}
+
+static inline const char *skip_blanks(const char *position, const char *end)
+{
+    while (position < end && is_blank(*position))
+    {
+        ++position;
+    }
+    return position;
+}
+
+static inline const char *token_end(const char *position, const char *end)
+{
+    while (position < end && !is_blank(*position))
+    {
+        ++position;
+    }
+    return position;
+}
+
+/** Decimal number in form (-1)^negative * mantissa * 10^exponent */
+class DecimalNumber {
+public:
+    bool negative = false;
+    uint64_t mantissa = 0;
+    int exponent = 0;
+};
+
+/**
+ * Scans plain decimal notation [sign]digits[.digits][e[sign]digits] occupying the whole [`begin`; `end`)
+ * Returns false for other forms and for mantissas that do not fit into 19 digits
+ */
+static bool scan_decimal(const char *begin, const char *end, DecimalNumber &number)
+{
+    static const int MAX_DIGITS = 19;
+    const char *position = begin;
+    if (position < end && (*position == '-' || *position == '+'))
+    {
+        number.negative = *position == '-';
+        ++position;
+    }
+    int digits = 0;
+    int significant_digits = 0;
+    bool point = false;
+    for (; position < end; ++position)
+    {
+        if (*position == '.' && !point)
+        {
+            point = true;
+            continue;
+        }
+        if (*position < '0' || *position > '9')
+        {
+            break;
+        }
+        ++digits;
+        if (number.mantissa != 0 || *position != '0')
+        {
+            if (++significant_digits > MAX_DIGITS)
+            {
+                return false;
+            }
+        }
+        number.mantissa = number.mantissa * 10 + (*position - '0');
+        if (point)
+        {
+            --number.exponent;
+        }
+    }
+    if (digits == 0)
+    {
+        return false;
+    }
+    if (position < end && (*position == 'e' || *position == 'E'))
+    {
+        ++position;
+        bool negative_exponent = false;
+        if (position < end && (*position == '-' || *position == '+'))
+        {
+            negative_exponent = *position == '-';
+            ++position;
+        }
+        if (position == end)
+        {
+            return false;
+        }
+        int exponent = 0;
+        for (; position < end && *position >= '0' && *position <= '9'; ++position)
+        {
+            exponent = std::min(exponent * 10 + (*position - '0'), 100000);
+        }
+        number.exponent += negative_exponent ? -exponent : exponent;
+    }
+    return position == end;
+}
+
+/*
+ * If both mantissa and power of ten are exact in type T, single division or multiplication
+ * rounds correctly, so the result is the same as the one of strtof/strtod
+ */
+static bool fast_convert(const DecimalNumber &number, double &value)
+{
+    static const double POWERS[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    if (number.mantissa > (1ull << 53) || number.exponent < -22 || number.exponent > 22)
+    {
+        return false;
+    }
+    value = (double) number.mantissa;
+    value = number.exponent < 0 ? value / POWERS[-number.exponent] : value * POWERS[number.exponent];
+    value = number.negative ? -value : value;
+    return true;
+}
+
+static bool fast_convert(const DecimalNumber &number, float &value)
+{
+    static const float POWERS[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+    if (number.mantissa > (1ull << 24) || number.exponent < -10 || number.exponent > 10)
+    {
+        return false;
+    }
+    value = (float) number.mantissa;
+    value = number.exponent < 0 ? value / POWERS[-number.exponent] : value * POWERS[number.exponent];
+    value = number.negative ? -value : value;
+    return true;
+}
+
+static void slow_convert(const char *text, double &value)
+{
+    value = std::strtod(text, nullptr);
+}
+
+static void slow_convert(const char *text, float &value)
+{
+    value = std::strtof(text, nullptr);
+}
+
+/** Parses next real number of the line. Returns pointer after it or nullptr if line has ended */
+template<typename T>
+static const char *parse_real(const char *position, const char *end, T &value)
+{
+    position = skip_blanks(position, end);
+    const char *number_end = token_end(position, end);
+    if (number_end == position)
+    {
+        return nullptr;
+    }
+    DecimalNumber number;
+    if (!scan_decimal(position, number_end, number) || !fast_convert(number, value))
+    {
+        // Long mantissas, big exponents, nan and inf are left to the C library
+        char text[64];
+        size_t length = std::min<size_t>(number_end - position, sizeof(text) - 1);
+        std::memcpy(text, position, length);
+        text[length] = '\0';
+        slow_convert(text, value);
+    }
+    return number_end;
+}
+
+/** Parses next integer of the line. Returns pointer after it or nullptr if line has ended or value is not integer */
+static const char *parse_integer(const char *position, const char *end, long long &value)
+{
+    position = skip_blanks(position, end);
+    bool negative = false;
+    if (position < end && (*position == '-' || *position == '+'))
+    {
+        negative = *position == '-';
+        ++position;
+    }
+    const char *digits_begin = position;
+    unsigned long long absolute = 0;
+    for (; position < end && *position >= '0' && *position <= '9'; ++position)
+    {
+        absolute = absolute * 10 + (*position - '0');
+    }
+    if (position == digits_begin || (position < end && !is_blank(*position)))
+    {
+        return nullptr;
+    }
+    value = negative ? -(long long) absolute : (long long) absolute;
+    return position;
+}
+
+/** Skips next `count` values of the line. Returns nullptr if line has ended */
+static const char *skip_values(const char *position, const char *end, size_t count)
+{
+    for (size_t value = 0; value < count; ++value)
+    {
+        position = skip_blanks(position, end);
+        if (position == end)
+        {
+            return nullptr;
+        }
+        position = token_end(position, end);
+    }
+    return position;
+}
+
+static const char *skip_property(const PlyProperty &property, const char *position, const char *end)
+{
+    if (!property.is_list)
+    {
+        return skip_values(position, end, 1);
+    }
+    long long count;
+    position = parse_integer(position, end, count);
+    if (position == nullptr || count < 0)
+    {
+        return nullptr;
+    }
+    return skip_values(position, end, count);
+}
+
+static bool parse_vertex_line(const PlyElement &element, const int coordinate_ids[3], const char *position,
+                              const char *end, Point &vertex)
+{
+    float *coordinates[3] = {&vertex.x, &vertex.y, &vertex.z};
+    for (int property_id = 0; property_id < (int) element.properties.size() && position != nullptr; ++property_id)
+    {
+        const PlyProperty &property = element.properties[property_id];
+        int axis = std::find(coordinate_ids, coordinate_ids + 3, property_id) - coordinate_ids;
+        if (axis == 3)
+        {
+            position = skip_property(property, position, end);
+        }
+        else if (property.type == PLY_FLOAT32)
+        {
+            position = parse_real(position, end, *coordinates[axis]);
+        }
+        else
+        {
+            // Same double to float conversion as in Figure constructor
+            double value = 0;
+            position = parse_real(position, end, value);
+            *coordinates[axis] = (float) value;
+        }
+    }
+    return position != nullptr;
+}
+
+/** Parses face line and appends indices of its vertices to `indices` */
+template<typename Index>
+static bool parse_face_line(const PlyElement &element, int indices_id, const char *position, const char *end,
+                            std::vector<Index> &indices)
+{
+    for (int property_id = 0; property_id < (int) element.properties.size() && position != nullptr; ++property_id)
+    {
+        if (property_id != indices_id)
+        {
+            position = skip_property(element.properties[property_id], position, end);
+            continue;
+        }
+        long long count;
+        position = parse_integer(position, end, count);
+        if (position == nullptr || count < 0)
+        {
+            return false;
+        }
+        for (long long i = 0; i < count && position != nullptr; ++i)
+        {
+            long long index;
+            position = parse_integer(position, end, index);
+            indices.push_back(static_cast<Index>(index));
+        }
+    }
+    return position != nullptr;
+}
+
+/** Returns the first line start at or after `position` */
+static const char *line_start(const char *data, const char *position, const char *end)
+{
+    if (position == data)
+    {
+        return position;
+    }
+    const void *newline = std::memchr(position - 1, '\n', end - (position - 1));
+    return newline == nullptr ? end : static_cast<const char *>(newline) + 1;
+}
+
+template<typename Index>
+bool read_ascii_mesh(const char *begin, const char *end, const PlyHeader &header, VertexStreams &vertices,
+                     std::vector<Index> &indices, std::vector<size_t> &face_offsets)
+{
+    static const size_t MIN_CHUNK = 1 << 20;
+
+    const PlyElement *vertex_element;
+    const PlyElement *face_element;
+    int indices_id;
+    if (header.format != PLY_ASCII || !find_mesh_elements(header, vertex_element, face_element, indices_id))
+    {
+        return false;
+    }
+    int coordinate_ids[3] = {vertex_element->find_property("x"),
+                             vertex_element->find_property("y"),
+                             vertex_element->find_property("z")};
+
+    // Every element record is one line, so line number tells which element and record it holds
+    size_t vertex_first_line = 0;
+    size_t face_first_line = 0;
+    size_t total_lines = 0;
+    for (const PlyElement &element : header.elements)
+    {
+        if (&element == vertex_element)
+        {
+            vertex_first_line = total_lines;
+        }
+        else if (&element == face_element)
+        {
+            face_first_line = total_lines;
+        }
+        total_lines += element.count;
+    }
+
+    // Chunk boundaries are moved forward to line starts, then lines are counted in every chunk
+    const char *data = begin + header.data_offset;
+    size_t length = end - data;
+    size_t chunks = std::max<size_t>(1, std::min(thread_count(), length / MIN_CHUNK));
+    std::vector<const char *> chunk_begin(chunks + 1, end);
+    std::vector<size_t> chunk_first_line(chunks + 1, 0);
+    parallel_for(chunks, 1, [&](size_t first, size_t last) {
+        for (size_t chunk = first; chunk < last; ++chunk)
+        {
+            const char *chunk_start = line_start(data, data + length * chunk / chunks, end);
+            const char *chunk_end = line_start(data, data + length * (chunk + 1) / chunks, end);
+            size_t lines = std::count(chunk_start, chunk_end, '\n');
+            if (chunk_end == end && chunk_end > chunk_start && chunk_end[-1] != '\n')
+            {
+                ++lines;
+            }
+            chunk_begin[chunk] = chunk_start;
+            chunk_first_line[chunk + 1] = lines;
+        }
+    });
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+        chunk_first_line[chunk + 1] += chunk_first_line[chunk];
+    }
+    if (chunk_first_line[chunks] < total_lines)
+    {
+        throw std::runtime_error("PLY reader: unexpected end of file");
+    }
+
+    vertices = VertexStreams(vertex_element->count);
+    // Faces of every chunk are collected separately and joined in order of chunks
+    std::vector<std::vector<Index>> chunk_indices(chunks);
+    std::vector<std::vector<size_t>> chunk_face_sizes(chunks);
+    std::atomic<bool> malformed(false);
+    parallel_for(chunks, 1, [&](size_t first, size_t last) {
+        for (size_t chunk = first; chunk < last; ++chunk)
+        {
+            const char *position = chunk_begin[chunk];
+            const char *chunk_end = chunk_begin[chunk + 1];
+            for (size_t line = chunk_first_line[chunk]; position < chunk_end && line < total_lines; ++line)
+            {
+                const char *line_end = static_cast<const char *>(std::memchr(position, '\n', chunk_end - position));
+                line_end = line_end == nullptr ? chunk_end : line_end;
+                bool parsed = true;
+                if (line - vertex_first_line < vertex_element->count)
+                {
+                    Point vertex;
+                    parsed = parse_vertex_line(*vertex_element, coordinate_ids, position, line_end, vertex);
+                    vertices.set(line - vertex_first_line, vertex);
+                }
+                else if (line - face_first_line < face_element->count)
+                {
+                    size_t face_begin = chunk_indices[chunk].size();
+                    parsed = parse_face_line(*face_element, indices_id, position, line_end, chunk_indices[chunk]);
+                    chunk_face_sizes[chunk].push_back(chunk_indices[chunk].size() - face_begin);
+                }
+                if (!parsed)
+                {
+                    malformed = true;
+                    return;
+                }
+                position = line_end + 1;
+            }
+        }
+    });
+    if (malformed)
+    {
+        throw std::runtime_error("PLY reader: malformed ascii data");
+    }
+
+    indices.clear();
+    face_offsets.assign(1, 0);
+    face_offsets.reserve(face_element->count + 1);
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+        indices.insert(indices.end(), chunk_indices[chunk].begin(), chunk_indices[chunk].end());
+        std::vector<Index>().swap(chunk_indices[chunk]);
+        for (size_t size : chunk_face_sizes[chunk])
+        {
+            face_offsets.push_back(face_offsets.back() + size);
+        }
+    }
+    return true;
+}
+
+template bool read_ascii_mesh(const char *begin, const char *end, const PlyHeader &header,
+                              VertexStreams &vertices, std::vector<uint32_t> &indices,
+                              std::vector<size_t> &face_offsets);
+template bool read_ascii_mesh(const char *begin, const char *end, const PlyHeader &header,
+                              VertexStreams &vertices, std::vector<size_t> &indices,
+                              std::vector<size_t> &face_offsets);
@@ -0,0 +1,241 @@
+#include <cstdint>
+#include <stdexcept>
+#include "ply_writer.h"
+#include "ply_reader.h"
+#include "output_file.h"
+#include "parallel.h"
+
+static const size_t TEXCOORD_RECORD_SIZE = sizeof(uint8_t) + 6 * sizeof(float);
+static const size_t UV_RECORD_SIZE = 2 * sizeof(float);
+
+static std::string mesh_header(size_t vertices, size_t uvs, size_t faces, bool has_uvs, PlySchema schema)
+{
+    std::string coordinate_type = schema == PLY_SCHEMA_COMPACT ? "float" : "double";
+    std::string header = "ply\n"
+                         "format binary_little_endian 1.0\n"
+                         "element vertex " + std::to_string(vertices) + "\n"
+                         "property " + coordinate_type + " x\n"
+                         "property " + coordinate_type + " y\n"
+                         "property " + coordinate_type + " z\n";
+    if (has_uvs && schema == PLY_SCHEMA_COMPACT)
+    {
+        header += "element uv " + std::to_string(uvs) + "\n"
+                  "property float u\n"
+                  "property float v\n";
+    }
+    header += "element face " + std::to_string(faces) + "\n"
+              "property list uchar uint vertex_indices\n";
+    if (has_uvs)
+    {
+        header += schema == PLY_SCHEMA_COMPACT ? "property list uchar uint uv_indices\n"
+                                               : "property list uchar float texcoord\n";
+    }
+    return header + "end_header\n";
+}
+
+static size_t vertex_record_size(PlySchema schema)
+{
+    return schema == PLY_SCHEMA_COMPACT ? 3 * sizeof(float) : 3 * sizeof(double);
+}
+
+static size_t face_record_size(size_t face_size, const std::vector<size_t> *uvface, PlySchema schema)
+{
+    size_t size = sizeof(uint8_t) + face_size * sizeof(uint32_t);
+    if (uvface != nullptr)
+    {
+        size += schema == PLY_SCHEMA_COMPACT ? sizeof(uint8_t) + uvface->size() * sizeof(uint32_t)
+                                             : TEXCOORD_RECORD_SIZE;
+    }
+    return size;
+}
+
+static uint8_t to_ply_count(size_t count)
+{
+    if (count > UINT8_MAX)
+    {
+        throw std::runtime_error("PLY writer: face has more vertices than fit in uchar list count");
+    }
+    return (uint8_t) count;
+}
+
+static uint32_t to_ply_index(size_t index)
+{
+    if (index > UINT32_MAX)
+    {
+        throw std::runtime_error("PLY writer: index " + std::to_string(index) + " does not fit into 32 bits");
+    }
+    return (uint32_t) index;
+}
+
+static void write_vertices(BufferedWriter &out, const VertexStreams &vertices, PlySchema schema,
+                           size_t first, size_t last)
+{
+    const float *x = vertices.x();
+    const float *y = vertices.y();
+    const float *z = vertices.z();
+    for (size_t vertex_id = first; vertex_id < last; ++vertex_id)
+    {
+        if (schema == PLY_SCHEMA_COMPACT)
+        {
+            out.put<float>(x[vertex_id]);
+            out.put<float>(y[vertex_id]);
+            out.put<float>(z[vertex_id]);
+        }
+        else
+        {
+            out.put<double>(x[vertex_id]);
+            out.put<double>(y[vertex_id]);
+            out.put<double>(z[vertex_id]);
+        }
+    }
+}
+
+static void write_uvs(BufferedWriter &out, const std::vector<Point2d> &uvs, size_t first, size_t last)
+{
+    for (size_t uv_id = first; uv_id < last; ++uv_id)
+    {
+        out.put<float>(uvs[uv_id].x);
+        out.put<float>(uvs[uv_id].y);
+    }
+}
+
+template<typename List>
+static void write_list(BufferedWriter &out, const List &list)
+{
+    out.put<uint8_t>(to_ply_count(list.size()));
+    for (size_t value : list)
+    {
+        out.put<uint32_t>(to_ply_index(value));
+    }
+}
+
+template<typename Index>
+static void write_faces(BufferedWriter &out, const BasicFigure<Index> &figure, const std::vector<Point2d> *uvs,
+                        const std::vector<std::vector<size_t>> *uvfaces, PlySchema schema, size_t first, size_t last)
+{
+    for (size_t face_id = first; face_id < last; ++face_id)
+    {
+        write_list(out, figure.face(face_id));
+        if (uvs == nullptr)
+        {
+            continue;
+        }
+        if (schema == PLY_SCHEMA_COMPACT)
+        {
+            write_list(out, (*uvfaces)[face_id]);
+            continue;
+        }
+        out.put<uint8_t>(6);
+        for (int v_id = 0; v_id < 3; ++v_id)
+        {
+            const Point2d &uv = (*uvs)[(*uvfaces)[face_id][v_id]];
+            out.put<float>(uv.x);
+            out.put<float>(uv.y);
+        }
+    }
+}
+
+template<typename Index>
+void write_ply(const std::string &filename, const BasicFigure<Index> &figure, bool parallel, PlySchema schema,
+               const std::vector<Point2d> *uvs, const std::vector<std::vector<size_t>> *uvfaces)
+{
+    static const size_t MIN_RANGE = 1 << 16;
+
+    if (!is_little_endian())
+    {
+        throw std::runtime_error("PLY writer: binary writing assumes little endian system");
+    }
+    const VertexStreams &vertices = figure.get_vertices();
+    size_t face_count = figure.face_count();
+    if (uvs == nullptr || uvfaces == nullptr)
+    {
+        uvs = nullptr;
+        uvfaces = nullptr;
+    }
+    size_t uv_count = uvs != nullptr && schema == PLY_SCHEMA_COMPACT ? uvs->size() : 0;
+    std::string header = mesh_header(vertices.size(), uv_count, face_count, uvs != nullptr, schema);
+    OutputFile file(filename);
+
+    if (!parallel)
+    {
+        BufferedWriter out(file, 0);
+        out.write(header.data(), header.size());
+        write_vertices(out, vertices, schema, 0, vertices.size());
+        if (uv_count > 0)
+        {
+            write_uvs(out, *uvs, 0, uv_count);
+        }
+        write_faces(out, figure, uvs, uvfaces, schema, 0, face_count);
+        out.flush();
+        return;
+    }
+
+    size_t vertex_blocks = std::max<size_t>(1, std::min(thread_count(), vertices.size() / MIN_RANGE));
+    size_t uv_blocks = std::max<size_t>(1, std::min(thread_count(), uv_count / MIN_RANGE));
+    size_t face_blocks = std::max<size_t>(1, std::min(thread_count(), face_count / MIN_RANGE));
+    size_t vertex_offset = header.size();
+    size_t uv_offset = vertex_offset + vertices.size() * vertex_record_size(schema);
+
+    // Face records differ in size only by number of indices, so offset of every face block is a prefix sum
+    std::vector<size_t> face_block_offset(face_blocks + 1, 0);
+    parallel_for(face_blocks, 1, [&](size_t first, size_t last) {
+        for (size_t block = first; block < last; ++block)
+        {
+            size_t size = 0;
+            for (size_t face_id = face_count * block / face_blocks;
+                 face_id < face_count * (block + 1) / face_blocks; ++face_id)
+            {
+                size += face_record_size(figure.face(face_id).size(),
+                        uvs != nullptr ? &(*uvfaces)[face_id] : nullptr, schema);
+            }
+            face_block_offset[block + 1] = size;
+        }
+    });
+    face_block_offset[0] = uv_offset + uv_count * UV_RECORD_SIZE;
+    for (size_t block = 0; block < face_blocks; ++block)
+    {
+        face_block_offset[block + 1] += face_block_offset[block];
+    }
+
+    file.preallocate(face_block_offset[face_blocks]);
+    file.write_at(header.data(), header.size(), 0);
+    // Vertex blocks go first, then uv blocks and face blocks, and all of them are written at the same time
+    parallel_for(vertex_blocks + uv_blocks + face_blocks, 1, [&](size_t first, size_t last) {
+        for (size_t block = first; block < last; ++block)
+        {
+            if (block < vertex_blocks)
+            {
+                size_t first_vertex = vertices.size() * block / vertex_blocks;
+                size_t last_vertex = vertices.size() * (block + 1) / vertex_blocks;
+                BufferedWriter out(file, vertex_offset + first_vertex * vertex_record_size(schema));
+                write_vertices(out, vertices, schema, first_vertex, last_vertex);
+                out.flush();
+            }
+            else if (block < vertex_blocks + uv_blocks)
+            {
+                size_t uv_block = block - vertex_blocks;
+                size_t first_uv = uv_count * uv_block / uv_blocks;
+                size_t last_uv = uv_count * (uv_block + 1) / uv_blocks;
+                if (first_uv < last_uv)
+                {
+                    BufferedWriter out(file, uv_offset + first_uv * UV_RECORD_SIZE);
+                    write_uvs(out, *uvs, first_uv, last_uv);
+                    out.flush();
+                }
+            }
+            else
+            {
+                size_t face_block = block - vertex_blocks - uv_blocks;
+                BufferedWriter out(file, face_block_offset[face_block]);
+                write_faces(out, figure, uvs, uvfaces, schema, face_count * face_block / face_blocks,
+                        face_count * (face_block + 1) / face_blocks);
+                out.flush();
+            }
+        }
+    });
+}
+
+template void write_ply(const std::string &filename, const Figure32 &figure, bool parallel, PlySchema schema,
+                        const std::vector<Point2d> *uvs, const std::vector<std::vector<size_t>> *uvfaces);
+template void write_ply(const std::string &filename, const Figure &figure, bool parallel, PlySchema schema,
+                        const std::vector<Point2d> *uvs, const std::vector<std::vector<size_t>> *uvfaces);
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <vector>
+#include "parallel.h"
+#include "radix_sort.h"
+
+/** Bits of key sorted by one pass. Histogram of 2048 counters of one chunk fits into L1 cache */
+static const int DIGIT_BITS = 11;
+static const size_t BUCKETS = (size_t) 1 << DIGIT_BITS;
+static const int KEY_BITS = 32;
+/** Chunks shorter than this are not worth a thread */
+static const size_t MIN_CHUNK = (size_t) 1 << 16;
+
+template<typename T>
+static inline size_t digit(T value, int shift)
+{
+    return (size_t) (value >> shift) & (BUCKETS - 1);
+}
+
+template<typename T>
+void radix_sort_by_key(T *data, T *buffer, size_t count, size_t max_threads)
+{
+    size_t chunks = std::max<size_t>(1, std::min(max_threads, count / MIN_CHUNK));
+    std::vector<size_t> offsets(chunks * BUCKETS);
+    T *from = data;
+    T *to = buffer;
+    const int key_shift = 8 * sizeof(T) - KEY_BITS;
+    for (int bit = 0; bit < KEY_BITS; bit += DIGIT_BITS)
+    {
+        int shift = key_shift + bit;
+        std::fill(offsets.begin(), offsets.end(), 0);
+        parallel_for(chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+            for (size_t chunk = first_chunk; chunk < last_chunk; ++chunk)
+            {
+                size_t *histogram = offsets.data() + chunk * BUCKETS;
+                for (size_t i = count * chunk / chunks; i < count * (chunk + 1) / chunks; ++i)
+                {
+                    ++histogram[digit(from[i], shift)];
+                }
+            }
+        });
+
+        // Digit is the same for every value, so the pass would not change the order
+        bool trivial = false;
+        for (size_t bucket = 0; bucket < BUCKETS && !trivial; ++bucket)
+        {
+            size_t total = 0;
+            for (size_t chunk = 0; chunk < chunks; ++chunk)
+            {
+                total += offsets[chunk * BUCKETS + bucket];
+            }
+            trivial = total == count;
+        }
+        if (trivial)
+        {
+            continue;
+        }
+
+        // Values of a chunk go after values of the same digit from previous chunks, so the sort is stable
+        size_t position = 0;
+        for (size_t bucket = 0; bucket < BUCKETS; ++bucket)
+        {
+            for (size_t chunk = 0; chunk < chunks; ++chunk)
+            {
+                size_t bucket_size = offsets[chunk * BUCKETS + bucket];
+                offsets[chunk * BUCKETS + bucket] = position;
+                position += bucket_size;
+            }
+        }
+
+        parallel_for(chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+            for (size_t chunk = first_chunk; chunk < last_chunk; ++chunk)
+            {
+                size_t *next = offsets.data() + chunk * BUCKETS;
+                for (size_t i = count * chunk / chunks; i < count * (chunk + 1) / chunks; ++i)
+                {
+                    to[next[digit(from[i], shift)]++] = from[i];
+                }
+            }
+        });
+        std::swap(from, to);
+    }
+    if (from != data)
+    {
+        std::copy(from, from + count, data);
+    }
+}
+
+template void radix_sort_by_key(uint64_t *data, uint64_t *buffer, size_t count, size_t max_threads);
+template void radix_sort_by_key(unsigned __int128 *data, unsigned __int128 *buffer, size_t count,
+                                size_t max_threads);
@@ -0,0 +1,103 @@
+#include "save_queue.h"
+#include "ply.h"
+
+template<typename Index>
+SaveQueue<Index>::SaveQueue(size_t thread_count, const Parameters &params) : params(params)
+{
+    for (size_t thread_id = 0; thread_id < thread_count; ++thread_id)
+    {
+        threads.emplace_back(&SaveQueue<Index>::work, this);
+    }
+}
+
+template<typename Index>
+SaveQueue<Index>::~SaveQueue()
+{
+    try
+    {
+        finish();
+    }
+    catch (...)
+    {
+    }
+}
+
+template<typename Index>
+void SaveQueue<Index>::save(const Task &task)
+{
+    try
+    {
+        save_figure(*task.figure, task.filename, params);
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+        {
+            error = std::current_exception();
+        }
+    }
+}
+
+template<typename Index>
+void SaveQueue<Index>::work()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        task_added.wait(lock, [this] { return finished || !tasks.empty(); });
+        if (tasks.empty())
+        {
+            return;
+        }
+        Task task = std::move(tasks.front());
+        tasks.pop_front();
+        lock.unlock();
+        save(task);
+        task.figure.reset();
+        lock.lock();
+    }
+}
+
+template<typename Index>
+void SaveQueue<Index>::push(std::shared_ptr<const BasicFigure<Index>> figure, const std::string &filename)
+{
+    Task task = {std::move(figure), filename};
+    if (threads.empty())
+    {
+        save(task);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    task_added.notify_one();
+}
+
+template<typename Index>
+void SaveQueue<Index>::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    task_added.notify_all();
+    for (std::thread &thread : threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (error)
+    {
+        std::exception_ptr saved_error = error;
+        error = nullptr;
+        std::rethrow_exception(saved_error);
+    }
+}
+
+template class SaveQueue<uint32_t>;
+template class SaveQueue<size_t>;
@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "turn_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TURN_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+static void project_scalar(const float *x, const float *y, const float *z, size_t count, const Vec3 &direction,
+                           float *projected)
+{
+    for (size_t vertex_id = 0; vertex_id < count; ++vertex_id)
+    {
+        projected[vertex_id] = x[vertex_id] * direction[0] + y[vertex_id] * direction[1] + z[vertex_id] * direction[2];
+    }
+}
+
+static void turn_scalar(const float *x, const float *y, const float *z, size_t count, const Mat3 &rotation_matrix,
+                        float *const *turned)
+{
+    const float (&matrix)[3][3] = rotation_matrix.matrix;
+    for (size_t vertex_id = 0; vertex_id < count; ++vertex_id)
+    {
+        for (int column = 0; column < 3; ++column)
+        {
+            turned[column][vertex_id] = x[vertex_id] * matrix[0][column] + y[vertex_id] * matrix[1][column] +
+                                        z[vertex_id] * matrix[2][column];
+        }
+    }
+}
+
+#ifdef TURN_KERNELS_X86
+
+// Multiplications and additions are done in the same order as in `Point::turned`, so results are the same as scalar
+__attribute__((target("sse2")))
+static void project_sse2(const float *x, const float *y, const float *z, size_t count, const Vec3 &direction,
+                         float *projected)
+{
+    __m128 dx = _mm_set1_ps(direction[0]);
+    __m128 dy = _mm_set1_ps(direction[1]);
+    __m128 dz = _mm_set1_ps(direction[2]);
+    for (size_t vertex_id = 0; vertex_id < count; vertex_id += 4)
+    {
+        __m128 sum = _mm_mul_ps(_mm_loadu_ps(x + vertex_id), dx);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(y + vertex_id), dy));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(z + vertex_id), dz));
+        _mm_storeu_ps(projected + vertex_id, sum);
+    }
+}
+
+__attribute__((target("sse2")))
+static void turn_sse2(const float *x, const float *y, const float *z, size_t count, const Mat3 &rotation_matrix,
+                      float *const *turned)
+{
+    __m128 matrix[3][3];
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 3; ++column)
+        {
+            matrix[row][column] = _mm_set1_ps(rotation_matrix.matrix[row][column]);
+        }
+    }
+    for (size_t vertex_id = 0; vertex_id < count; vertex_id += 4)
+    {
+        __m128 vx = _mm_loadu_ps(x + vertex_id);
+        __m128 vy = _mm_loadu_ps(y + vertex_id);
+        __m128 vz = _mm_loadu_ps(z + vertex_id);
+        for (int column = 0; column < 3; ++column)
+        {
+            __m128 sum = _mm_mul_ps(vx, matrix[0][column]);
+            sum = _mm_add_ps(sum, _mm_mul_ps(vy, matrix[1][column]));
+            sum = _mm_add_ps(sum, _mm_mul_ps(vz, matrix[2][column]));
+            _mm_storeu_ps(turned[column] + vertex_id, sum);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void project_avx2(const float *x, const float *y, const float *z, size_t count, const Vec3 &direction,
+                         float *projected)
+{
+    __m256 dx = _mm256_set1_ps(direction[0]);
+    __m256 dy = _mm256_set1_ps(direction[1]);
+    __m256 dz = _mm256_set1_ps(direction[2]);
+    for (size_t vertex_id = 0; vertex_id < count; vertex_id += 8)
+    {
+        __m256 sum = _mm256_mul_ps(_mm256_loadu_ps(x + vertex_id), dx);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(y + vertex_id), dy));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(z + vertex_id), dz));
+        _mm256_storeu_ps(projected + vertex_id, sum);
+    }
+}
+
+__attribute__((target("avx2")))
+static void turn_avx2(const float *x, const float *y, const float *z, size_t count, const Mat3 &rotation_matrix,
+                      float *const *turned)
+{
+    __m256 matrix[3][3];
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 3; ++column)
+        {
+            matrix[row][column] = _mm256_set1_ps(rotation_matrix.matrix[row][column]);
+        }
+    }
+    for (size_t vertex_id = 0; vertex_id < count; vertex_id += 8)
+    {
+        __m256 vx = _mm256_loadu_ps(x + vertex_id);
+        __m256 vy = _mm256_loadu_ps(y + vertex_id);
+        __m256 vz = _mm256_loadu_ps(z + vertex_id);
+        for (int column = 0; column < 3; ++column)
+        {
+            __m256 sum = _mm256_mul_ps(vx, matrix[0][column]);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(vy, matrix[1][column]));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(vz, matrix[2][column]));
+            _mm256_storeu_ps(turned[column] + vertex_id, sum);
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void project_avx512(const float *x, const float *y, const float *z, size_t count, const Vec3 &direction,
+                           float *projected)
+{
+    __m512 dx = _mm512_set1_ps(direction[0]);
+    __m512 dy = _mm512_set1_ps(direction[1]);
+    __m512 dz = _mm512_set1_ps(direction[2]);
+    for (size_t vertex_id = 0; vertex_id < count; vertex_id += 16)
+    {
+        __m512 sum = _mm512_mul_ps(_mm512_loadu_ps(x + vertex_id), dx);
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_loadu_ps(y + vertex_id), dy));
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_loadu_ps(z + vertex_id), dz));
+        _mm512_storeu_ps(projected + vertex_id, sum);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void turn_avx512(const float *x, const float *y, const float *z, size_t count, const Mat3 &rotation_matrix,
+                        float *const *turned)
+{
+    __m512 matrix[3][3];
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 3; ++column)
+        {
+            matrix[row][column] = _mm512_set1_ps(rotation_matrix.matrix[row][column]);
+        }
+    }
+    for (size_t vertex_id = 0; vertex_id < count; vertex_id += 16)
+    {
+        __m512 vx = _mm512_loadu_ps(x + vertex_id);
+        __m512 vy = _mm512_loadu_ps(y + vertex_id);
+        __m512 vz = _mm512_loadu_ps(z + vertex_id);
+        for (int column = 0; column < 3; ++column)
+        {
+            __m512 sum = _mm512_mul_ps(vx, matrix[0][column]);
+            sum = _mm512_add_ps(sum, _mm512_mul_ps(vy, matrix[1][column]));
+            sum = _mm512_add_ps(sum, _mm512_mul_ps(vz, matrix[2][column]));
+            _mm512_storeu_ps(turned[column] + vertex_id, sum);
+        }
+    }
+}
+
+#endif
+
+static KernelIsa detect_kernel_isa()
+{
+#ifdef TURN_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return KERNEL_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return KERNEL_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return KERNEL_SSE2;
+    }
+#endif
+    return KERNEL_SCALAR;
+}
+
+KernelIsa kernel_isa()
+{
+    static const KernelIsa isa = detect_kernel_isa();
+    return isa;
+}
+
+bool is_kernel_isa_supported(KernelIsa isa)
+{
+    // Every instruction set includes the previous ones
+    return isa <= kernel_isa();
+}
+
+const char *kernel_isa_name(KernelIsa isa)
+{
+    switch (isa)
+    {
+        case KERNEL_SSE2:
+            return "sse2";
+        case KERNEL_AVX2:
+            return "avx2";
+        case KERNEL_AVX512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
+
+void project_streams(const float *x, const float *y, const float *z, size_t count, const Vec3 &direction,
+                     float *projected, KernelIsa isa)
+{
+    switch (isa)
+    {
+#ifdef TURN_KERNELS_X86
+        case KERNEL_AVX512:
+            project_avx512(x, y, z, count, direction, projected);
+            break;
+        case KERNEL_AVX2:
+            project_avx2(x, y, z, count, direction, projected);
+            break;
+        case KERNEL_SSE2:
+            project_sse2(x, y, z, count, direction, projected);
+            break;
+#endif
+        default:
+            project_scalar(x, y, z, count, direction, projected);
+    }
+}
+
+void project_streams(const float *x, const float *y, const float *z, size_t count, const Vec3 *directions,
+                     size_t direction_count, float *const *projected, KernelIsa isa)
+{
+    // 12 KB of coordinates of one block fit into L1 cache together with the part of outputs being written
+    static const size_t BLOCK = 1024;
+    for (size_t block = 0; block < count; block += BLOCK)
+    {
+        size_t block_size = std::min(BLOCK, count - block);
+        for (size_t direction = 0; direction < direction_count; ++direction)
+        {
+            project_streams(x + block, y + block, z + block, block_size, directions[direction],
+                            projected[direction] + block, isa);
+        }
+    }
+}
+
+void turn_streams(const float *x, const float *y, const float *z, size_t count, const Mat3 &rotation_matrix,
+                  float *turned_x, float *turned_y, float *turned_z, KernelIsa isa)
+{
+    float *const turned[3] = {turned_x, turned_y, turned_z};
+    switch (isa)
+    {
+#ifdef TURN_KERNELS_X86
+        case KERNEL_AVX512:
+            turn_avx512(x, y, z, count, rotation_matrix, turned);
+            break;
+        case KERNEL_AVX2:
+            turn_avx2(x, y, z, count, rotation_matrix, turned);
+            break;
+        case KERNEL_SSE2:
+            turn_sse2(x, y, z, count, rotation_matrix, turned);
+            break;
+#endif
+        default:
+            turn_scalar(x, y, z, count, rotation_matrix, turned);
+    }
+}
+
+/** Returns vertices per second of `kernel` that processes `count` vertices, repeated for at least 0.2 seconds */
+template<typename Kernel>
+static double measure_throughput(size_t count, const Kernel &kernel)
+{
+    static const double MIN_SECONDS = 0.2;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t repeats = 0;
+    double seconds = 0;
+    while (seconds < MIN_SECONDS)
+    {
+        kernel();
+        ++repeats;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return (double) count * repeats / seconds;
+}
+
+void benchmark_turn_kernels(const VertexStreams &vertices)
+{
+    const Vec3 direction = {{0.48f, -0.6f, 0.64f}};
+    const Mat3 rotation_matrix = {{{0.36f, 0.48f, -0.8f}, {-0.8f, 0.6f, 0}, {0.48f, 0.64f, 0.6f}}};
+    VertexStreams turned(vertices.size());
+    static const size_t BLOCKED_DIRECTIONS = 16;
+    Vec3 directions[BLOCKED_DIRECTIONS];
+    AlignedFloats projection_data(BLOCKED_DIRECTIONS * vertices.padded_size());
+    float *projections[BLOCKED_DIRECTIONS];
+    for (size_t direction = 0; direction < BLOCKED_DIRECTIONS; ++direction)
+    {
+        directions[direction] = {{rotation_matrix.matrix[0][direction % 3], rotation_matrix.matrix[1][direction % 3],
+                                  rotation_matrix.matrix[2][direction % 3]}};
+        projections[direction] = projection_data.data() + direction * vertices.padded_size();
+    }
+    std::cout << "Turn kernels on " << vertices.size() << " vertices, selected " << kernel_isa_name(kernel_isa())
+              << std::endl;
+    for (KernelIsa isa : {KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2, KERNEL_AVX512})
+    {
+        if (!is_kernel_isa_supported(isa))
+        {
+            continue;
+        }
+        double projection = measure_throughput(vertices.size(), [&]() {
+            project_streams(vertices.x(), vertices.y(), vertices.z(), vertices.padded_size(), direction,
+                            turned.x(), isa);
+        });
+        double rotation = measure_throughput(vertices.size(), [&]() {
+            turn_streams(vertices.x(), vertices.y(), vertices.z(), vertices.padded_size(), rotation_matrix,
+                         turned.x(), turned.y(), turned.z(), isa);
+        });
+        double blocked = measure_throughput(vertices.size() * BLOCKED_DIRECTIONS, [&]() {
+            project_streams(vertices.x(), vertices.y(), vertices.z(), vertices.padded_size(), directions,
+                            BLOCKED_DIRECTIONS, projections, isa);
+        });
+        std::cout << "    " << kernel_isa_name(isa) << ": projection " << projection / 1e6
+                  << " Mvertices/s, rotation " << rotation / 1e6 << " Mvertices/s, blocked projection on "
+                  << BLOCKED_DIRECTIONS << " directions " << blocked / 1e6 << " Mvertex-directions/s" << std::endl;
+    }
+}
@@ -0,0 +1,26 @@
+#include "vertex_streams.h"
+
+const size_t VertexStreams::WIDTH;
+
+VertexStreams::VertexStreams(size_t count) : count(count), padded_count((count + WIDTH - 1) / WIDTH * WIDTH)
+{
+    data.assign(3 * padded_count, 0);
+}
+
+VertexStreams::VertexStreams(const std::vector<Point> &points) : VertexStreams(points.size())
+{
+    for (size_t vertex_id = 0; vertex_id < count; ++vertex_id)
+    {
+        set(vertex_id, points[vertex_id]);
+    }
+}
+
+std::vector<Point> VertexStreams::to_points() const
+{
+    std::vector<Point> points(count);
+    for (size_t vertex_id = 0; vertex_id < count; ++vertex_id)
+    {
+        points[vertex_id] = (*this)[vertex_id];
+    }
+    return points;
+}